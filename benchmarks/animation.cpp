@@ -0,0 +1,173 @@
+/// Plays a channel of a keyframe animation on each of many props and measures AnimationSystem::update against
+/// sampling each prop on its own with quat::slerp and setting its transform with set_component.
+/// The sampled transforms are checked against that scalar reference, rotations with the approximated slerp have to
+/// be within 0.001 radians of quat::slerp and rotations with nlerp within float precision of quat::nlerp.
+/// Exits with EXIT_FAILURE if a sampled transform is off.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../nodes/animation.h"
+#include "../nodes/entitysystem.h"
+#include "../nodes/transform.h"
+#include "../util/jobsystem.h"
+
+static const size_t num_props = 20000;
+static const size_t num_clips = 8;
+static const size_t num_channels = 16;
+static const size_t num_frames = 100;
+static const float dt = 1.0f / 60.0f;
+
+/// Scalar reference of a track, advanced with the same float operations as AnimationSystem::update
+struct Track {
+  ID id;
+  const AnimationChannel* channel;
+  float time, speed, duration;
+};
+
+static void bracket(const std::vector<float>& times, const float time, size_t& a, size_t& b, float& t) {
+  const size_t next = size_t(std::upper_bound(times.begin(), times.end(), time) - times.begin());
+  a = next == 0 ? 0 : std::min(next, times.size()) - 1;
+  b = std::min(next, times.size() - 1);
+  t = a == b ? 0.0f : (time - times[a]) / (times[b] - times[a]);
+}
+
+static TransformComponent sample(const Track& track, const RotationInterpolation interpolation) {
+  const AnimationChannel& channel = *track.channel;
+  TransformComponent component;
+  size_t a = 0, b = 0;
+  float t = 0.0f;
+  bracket(channel.position_times, track.time, a, b, t);
+  const Vec3f position_a(channel.position_x[a], channel.position_y[a], channel.position_z[a]);
+  const Vec3f position_b(channel.position_x[b], channel.position_y[b], channel.position_z[b]);
+  component.position = position_a + (position_b - position_a) * t;
+  bracket(channel.rotation_times, track.time, a, b, t);
+  const quat rotation_a(Vec3f(channel.rotation_x[a], channel.rotation_y[a], channel.rotation_z[a]), channel.rotation_w[a]);
+  const quat rotation_b(Vec3f(channel.rotation_x[b], channel.rotation_y[b], channel.rotation_z[b]), channel.rotation_w[b]);
+  component.rotation = interpolation == RotationInterpolation::Slerp ? quat::slerp(rotation_a, rotation_b, t)
+                                                                     : quat::nlerp(rotation_a, rotation_b, t);
+  bracket(channel.scale_times, track.time, a, b, t);
+  const Vec3f scale_a(channel.scale_x[a], channel.scale_y[a], channel.scale_z[a]);
+  const Vec3f scale_b(channel.scale_x[b], channel.scale_y[b], channel.scale_z[b]);
+  component.scale = scale_a + (scale_b - scale_a) * t;
+  return component;
+}
+
+static void advance(Track& track) {
+  const float time = std::fmod(track.time + dt * track.speed, track.duration);
+  track.time = time < 0.0f ? time + track.duration : time;
+}
+
+/// Angle between the rotations of two unit quaternions, from the chord to the closer one of q and -q
+static double angle_between(const quat& p, const quat& q) {
+  double plus = 0.0, minus = 0.0;
+  const float ps[] = {p.v.x, p.v.y, p.v.z, p.w};
+  const float qs[] = {q.v.x, q.v.y, q.v.z, q.w};
+  for (size_t i = 0; i < 4; i++) {
+    plus += (double(ps[i]) - qs[i]) * (double(ps[i]) - qs[i]);
+    minus += (double(ps[i]) + qs[i]) * (double(ps[i]) + qs[i]);
+  }
+  return 4.0 * std::asin(std::min(1.0, std::sqrt(std::min(plus, minus)) / 2.0));
+}
+
+static AnimationClip random_clip(std::mt19937& rng, const size_t index) {
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::uniform_int_distribution<size_t> num_keys(2, 32);
+  AnimationClip clip;
+  clip.name = "clip" + std::to_string(index);
+  clip.duration = 2.0f;
+  for (size_t c = 0; c < num_channels; c++) {
+    AnimationChannel channel;
+    channel.node = "node" + std::to_string(c);
+    const size_t count = num_keys(rng);
+    for (size_t k = 0; k < count; k++) {
+      /// Keys spread over the duration, consecutive rotations up to about 180 degrees apart and on either hemisphere
+      const float time = clip.duration * float(k) / float(count - 1);
+      channel.add_position(time, Vec3f(unit(rng), unit(rng), unit(rng)) * 10.0f);
+      channel.add_rotation(time, quat(Vec3f(unit(rng), unit(rng), unit(rng)), unit(rng)).normalize());
+      channel.add_scale(time, Vec3f(1.5f) + Vec3f(unit(rng), unit(rng), unit(rng)) * 0.5f);
+    }
+    clip.channels.push_back(channel);
+  }
+  return clip;
+}
+
+int main() {
+  auto& transforms = TransformSystem::instance();
+  auto& animations = AnimationSystem::instance();
+  JobSystem::instance();
+
+  std::mt19937 rng(42);
+  std::vector<AnimationHandle> clips;
+  std::vector<AnimationClip> clip_data;
+  for (size_t i = 0; i < num_clips; i++) {
+    clip_data.push_back(random_clip(rng, i));
+    clips.push_back(animations.add_clip(clip_data.back()));
+  }
+
+  std::uniform_real_distribution<float> start(0.0f, 2.0f);
+  std::uniform_real_distribution<float> speed(-2.0f, 2.0f);
+  std::vector<Track> tracks(num_props);
+  transforms.reserve(num_props);
+  for (size_t i = 0; i < num_props; i++) {
+    Track& track = tracks[i];
+    track.id = EntitySystem::instance().new_entity();
+    track.channel = &clip_data[i % num_clips].channels[i % num_channels];
+    track.time = start(rng);
+    track.speed = speed(rng);
+    track.duration = clip_data[i % num_clips].duration;
+    transforms.add_component(TransformComponent(), track.id);
+    animations.play(track.id, clips[i % num_clips], uint32_t(i % num_channels), track.time, track.speed);
+  }
+  transforms.compose_dirty();
+  transforms.reset_dirty();
+
+  using namespace std::chrono;
+  bool accurate = true;
+  const std::pair<const char*, RotationInterpolation> modes[] = {
+    {"nlerp", RotationInterpolation::Nlerp}, {"slerp", RotationInterpolation::Slerp}
+  };
+  for (const auto& mode : modes) {
+    animations.set_rotation_interpolation(mode.second);
+    double update_ms = 0.0, reference_ms = 0.0;
+    double max_angle = 0.0, max_offset = 0.0;
+    for (size_t frame = 0; frame < num_frames; frame++) {
+      auto begin = high_resolution_clock::now();
+      animations.update(dt);
+      update_ms += duration<double, std::milli>(high_resolution_clock::now() - begin).count();
+      transforms.reset_dirty();
+
+      /// The reference sets the same transforms, check them before they are overwritten
+      std::vector<TransformComponent> sampled(num_props);
+      for (size_t i = 0; i < num_props; i++) {
+        sampled[i] = transforms.lookup_component(tracks[i].id);
+      }
+      begin = high_resolution_clock::now();
+      for (Track& track : tracks) {
+        advance(track);
+        transforms.set_component(sample(track, mode.second), track.id);
+      }
+      reference_ms += duration<double, std::milli>(high_resolution_clock::now() - begin).count();
+      transforms.reset_dirty();
+
+      for (size_t i = 0; i < num_props; i++) {
+        const TransformComponent expected = transforms.lookup_component(tracks[i].id);
+        max_angle = std::max(max_angle, angle_between(sampled[i].rotation, expected.rotation));
+        max_offset = std::max({max_offset, double((sampled[i].position - expected.position).length()),
+                               double((sampled[i].scale - expected.scale).length())});
+      }
+    }
+    const double max_allowed_angle = mode.second == RotationInterpolation::Slerp ? 1.0e-3 : 1.0e-5;
+    accurate &= max_angle <= max_allowed_angle && max_offset <= 1.0e-5;
+    std::printf("%s: %.3f ms / frame (scalar %.3f ms, %.2fx) for %zu props, max error %.2e rad, %.2e units\n",
+                mode.first, update_ms / num_frames, reference_ms / num_frames, reference_ms / update_ms, num_props,
+                max_angle, max_offset);
+  }
+  std::printf("workers: %zu, tracks: %zu\n", JobSystem::instance().num_workers(), animations.size());
+  if (!accurate) { std::printf("Sampled transforms differ from the scalar reference\n"); }
+  return accurate ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,98 @@
+/// Runs the simulation side of a frame (actions, transform updates and the copy into render instances)
+/// through the TaskGraph and JobSystem and counts the heap allocations made in steady state.
+/// Exits with EXIT_FAILURE if any frame after the warm up allocates.
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "../nodes/action.h"
+#include "../nodes/entitysystem.h"
+#include "../nodes/transform.h"
+#include "../util/jobsystem.h"
+#include "../util/taskgraph.h"
+
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size) {
+  allocations++;
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) { return ptr; }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+  allocations++;
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) { return ptr; }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+int main() {
+  const size_t num_entities = 50000;
+  const size_t warmup_frames = 100;
+  const size_t measured_frames = 1000;
+
+  auto& transforms = TransformSystem::instance();
+  auto& actions = ActionSystem::instance();
+  JobSystem::instance();
+
+  for (size_t i = 0; i < num_entities; i++) {
+    const ID id = EntitySystem::instance().new_entity();
+    TransformComponent component;
+    component.position = Vec3f(float(i % 100), 0.0f, float(i / 100));
+    transforms.add_component(component, id);
+    actions.add_component(ActionComponent([=](uint64_t frame, uint64_t) {
+      const Vec3f position(component.position.x, std::cos(frame * 0.025f), component.position.z);
+      TransformSystem::instance().set_position(position, id);
+    }), id);
+  }
+
+  /// Stand-in for the instance buffer of a graphics batch
+  std::vector<Transform> instances(num_entities + 1);
+
+  uint64_t frame = 0;
+  TaskGraph graph;
+  graph.add_system("Actions", {ComponentType::Action}, {ComponentType::Transform}, [&]() {
+    actions.execute_actions(frame, 16);
+  });
+  graph.add_system("Compose transforms", {ComponentType::Transform}, {ComponentType::Transform}, [&]() {
+    transforms.compose_dirty();
+  });
+  graph.add_system("Render transforms", {ComponentType::Transform}, {ComponentType::Render}, [&]() {
+    const std::vector<TransformChange>& journal = transforms.get_journal();
+    JobSystem::instance().parallel_for(0, journal.size(), 256, [&](const size_t begin, const size_t end) {
+      // Exercise the per-job scratch memory, released when the job finishes
+      Transform* staged = JobSystem::scratch().allocate<Transform>(end - begin);
+      for (size_t i = begin; i < end; i++) {
+        staged[i - begin] = transforms.at(journal[i].slot);
+      }
+      for (size_t i = begin; i < end; i++) {
+        instances[journal[i].entity_id] = staged[i - begin];
+      }
+    });
+    transforms.reset_dirty();
+  });
+
+  for (; frame < warmup_frames; frame++) {
+    graph.execute();
+  }
+
+  using namespace std::chrono;
+  const uint64_t allocations_before = allocations.load();
+  const auto start = high_resolution_clock::now();
+  for (size_t i = 0; i < measured_frames; i++, frame++) {
+    graph.execute();
+  }
+  const double total_ms = duration<double, std::milli>(high_resolution_clock::now() - start).count();
+  const uint64_t frame_allocations = allocations.load() - allocations_before;
+
+  std::printf("workers: %zu, entities: %zu, frames: %zu\n", JobSystem::instance().num_workers(), num_entities, measured_frames);
+  std::printf("%.3f ms / frame, %.3f allocations / frame\n", total_ms / measured_frames, double(frame_allocations) / measured_frames);
+  return frame_allocations == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
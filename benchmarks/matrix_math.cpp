@@ -0,0 +1,168 @@
+/// Compares the Mat4f/Vec3f operations against the scalar implementations they replaced, element by element on the
+/// bits, and measures both. Exits with EXIT_FAILURE if any result differs.
+/// translate and scale no longer add the products with the zeros of the full matrix, which only ever changed the sign
+/// of zero elements, so for those +0 and -0 are considered the same.
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../math/vector.h"
+
+/// The implementations before the SIMD specialisations
+namespace Reference {
+  static Mat4f multiply(const Mat4f& lhs, const Mat4f& mat) {
+    Mat4f matrix;
+    for (uint8_t i = 0; i < 4; ++i) {
+      const auto row = lhs[i];
+      for (uint8_t j = 0; j < 4; ++j) {
+        const Vec4f column = Vec4f{mat[0][j], mat[1][j], mat[2][j], mat[3][j]};
+        matrix[i][j] = row[0]*column[0] + row[1]*column[1] + row[2]*column[2] + row[3]*column[3];
+      }
+    }
+    return matrix;
+  }
+
+  static Vec4f multiply(const Mat4f& lhs, const Vec4f& rhs) {
+    Vec4f result;
+    for (int i = 0; i < 4; i++) {
+      result[i] = lhs[i].x * rhs.x + lhs[i].y * rhs.y + lhs[i].z * rhs.z + lhs[i].w * rhs.w;
+    }
+    return result;
+  }
+
+  static Mat4f translate(const Mat4f& lhs, const Vec3f& vec) {
+    Mat4f matrix;
+    matrix[0] = { 1.0f, 0.0f, 0.0f, 0.0f };
+    matrix[1] = { 0.0f, 1.0f, 0.0f, 0.0f };
+    matrix[2] = { 0.0f, 0.0f, 1.0f, 0.0f };
+    matrix[3] = { vec.x, vec.y, vec.z, 1.0f };
+    return multiply(lhs, matrix);
+  }
+
+  static Mat4f scale(const Mat4f& lhs, const float scale) {
+    Mat4f matrix;
+    matrix[0] = {scale, 0.0f, 0.0f, 0.0f};
+    matrix[1] = {0.0f, scale, 0.0f, 0.0f};
+    matrix[2] = {0.0f, 0.0f, scale, 0.0f};
+    matrix[3] = {0.0f, 0.0f,  0.0f, 1.0f};
+    return multiply(lhs, matrix);
+  }
+
+  static Mat4f transpose(const Mat4f& lhs) {
+    Mat4f mat;
+    for (size_t i = 0; i < 4; i++) {
+      for (size_t j = 0; j < 4; j++) {
+        mat[i][j] = lhs[j][i];
+      }
+    }
+    return mat;
+  }
+
+  static float length(const Vec3f& v) {
+    return std::sqrt(std::pow(v.x, 2) + std::pow(v.y, 2) + std::pow(v.z, 2));
+  }
+}
+
+static bool same_bits(const Mat4f& a, const Mat4f& b) { return std::memcmp(&a, &b, sizeof(Mat4f)) == 0; }
+static bool same_bits(const Vec4f& a, const Vec4f& b) { return std::memcmp(&a, &b, sizeof(Vec4f)) == 0; }
+static bool same_bits(const float a, const float b) { return std::memcmp(&a, &b, sizeof(float)) == 0; }
+static bool same_bits_or_zeros(const Mat4f& a, const Mat4f& b) {
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      if (!same_bits(a[i][j], b[i][j]) && !(a[i][j] == 0.0f && b[i][j] == 0.0f)) { return false; }
+    }
+  }
+  return true;
+}
+
+/// Runs func over all the inputs a few times and returns the time per call in nanoseconds
+template<typename F>
+static double measure(const size_t count, F func) {
+  const size_t rounds = 20;
+  const auto start = std::chrono::high_resolution_clock::now();
+  for (size_t round = 0; round < rounds; round++) {
+    for (size_t i = 0; i < count; i++) { func(i); }
+  }
+  const auto elapsed = std::chrono::high_resolution_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / double(rounds * count);
+}
+
+int main() {
+  const size_t count = 100000;
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> value(-100.0f, 100.0f);
+
+  std::vector<Mat4f> as(count), bs(count);
+  std::vector<Vec4f> vs(count);
+  std::vector<Vec3f> ts(count);
+  for (size_t i = 0; i < count; i++) {
+    for (size_t row = 0; row < 4; row++) {
+      as[i][row] = Vec4f(value(rng), value(rng), value(rng), value(rng));
+      bs[i][row] = Vec4f(value(rng), value(rng), value(rng), value(rng));
+    }
+    vs[i] = Vec4f(value(rng), value(rng), value(rng), value(rng));
+    ts[i] = Vec3f(value(rng), value(rng), value(rng));
+  }
+  /// Transforms as composed by the engine; identity, translated and scaled
+  for (size_t i = 0; i < count; i += 7) {
+    as[i] = Mat4f().translate(ts[i]).scale(ts[i].x);
+  }
+
+  size_t mismatches = 0;
+  for (size_t i = 0; i < count; i++) {
+    mismatches += !same_bits(as[i] * bs[i], Reference::multiply(as[i], bs[i]));
+    mismatches += !same_bits(as[i] * vs[i], Reference::multiply(as[i], vs[i]));
+    mismatches += !same_bits_or_zeros(as[i].translate(ts[i]), Reference::translate(as[i], ts[i]));
+    mismatches += !same_bits_or_zeros(as[i].scale(ts[i].y), Reference::scale(as[i], ts[i].y));
+    mismatches += !same_bits(as[i].transpose(), Reference::transpose(as[i]));
+    mismatches += !same_bits(ts[i].length(), Reference::length(ts[i]));
+  }
+
+  std::vector<Mat4f> out(count);
+  std::vector<Vec4f> out_vectors(count);
+  std::vector<float> out_lengths(count);
+  struct Result {
+    const char* name;
+    double reference_ns;
+    double ns;
+  };
+  const Result results[] = {
+    {"Mat4f * Mat4f",
+     measure(count, [&](const size_t i) { out[i] = Reference::multiply(as[i], bs[i]); }),
+     measure(count, [&](const size_t i) { out[i] = as[i] * bs[i]; })},
+    {"Mat4f * Vec4f",
+     measure(count, [&](const size_t i) { out_vectors[i] = Reference::multiply(as[i], vs[i]); }),
+     measure(count, [&](const size_t i) { out_vectors[i] = as[i] * vs[i]; })},
+    {"Mat4f::translate",
+     measure(count, [&](const size_t i) { out[i] = Reference::translate(as[i], ts[i]); }),
+     measure(count, [&](const size_t i) { out[i] = as[i].translate(ts[i]); })},
+    {"Mat4f::scale",
+     measure(count, [&](const size_t i) { out[i] = Reference::scale(as[i], ts[i].y); }),
+     measure(count, [&](const size_t i) { out[i] = as[i].scale(ts[i].y); })},
+    {"Mat4f::transpose",
+     measure(count, [&](const size_t i) { out[i] = Reference::transpose(as[i]); }),
+     measure(count, [&](const size_t i) { out[i] = as[i].transpose(); })},
+    {"Vec3f::length",
+     measure(count, [&](const size_t i) { out_lengths[i] = Reference::length(ts[i]); }),
+     measure(count, [&](const size_t i) { out_lengths[i] = ts[i].length(); })},
+  };
+
+#if defined(__AVX__)
+  std::printf("Mat4<float> specialisation: AVX\n");
+#elif defined(__SSE2__) || defined(_M_X64)
+  std::printf("Mat4<float> specialisation: SSE\n");
+#else
+  std::printf("Mat4<float> specialisation: none (scalar)\n");
+#endif
+  for (const Result& result : results) {
+    std::printf("%-18s %7.2f ns (scalar %7.2f ns, %.2fx)\n", result.name, result.ns, result.reference_ns,
+                result.reference_ns / result.ns);
+  }
+  std::printf("checksum: %f\n", double(out[count / 2][1].y + out_vectors[count / 3].z + out_lengths[count / 4]));
+  if (mismatches) { std::printf("%zu results differ from the scalar implementation\n", mismatches); }
+  return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
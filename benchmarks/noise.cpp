@@ -0,0 +1,321 @@
+/// Measures the speed and the output distribution of all the noise generators in math/noise.h, for single samples and
+/// for the fractal sums at one to eight octaves, and checks which of them tile.
+/// The results go to a CSV file (first argument, noise_benchmark.csv by default) in long format:
+///   generator,dimensions,function,octaves,metric,value
+/// with the metrics ns_per_sample, min, max, mean, stddev, histogram_00 to histogram_19 (fraction of the samples in
+/// each of 20 equal bins over [min, max]) and period (smallest power of two the noise repeats with, 0 if none up to
+/// 4096). A summary of the timings is printed.
+/// The compile-time pipelines (StaticFractal over StaticPerlin and StaticPerlinImproved) are measured the same way with
+/// the functions static_fbm and static_turbulence.
+/// Exits with EXIT_FAILURE if fill_grid differs from get_value by more than the float precision allows, or if a
+/// StaticFractal differs from the octave loop it unrolls.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../math/noise.h"
+
+static const size_t num_bins = 20;
+static const int max_octaves = 8;
+
+/// 2D samples are taken on a 256 x 256 grid and 3D samples on a 64 x 32 x 32 grid, single samples with a step that
+/// does not line up with the lattice and fractal sums with the unit step of the blocks in the world
+static const size_t side_2d = 256;
+static const size_t width_3d = 64, side_3d = 32;
+static const double raw_step = 0.37;
+
+struct Generator {
+  const char* name;
+  const Noise& noise;
+  bool has_3d; // Simplex_Tables only implements 2D
+};
+
+class Report {
+  std::FILE* csv;
+
+public:
+  explicit Report(std::FILE* csv): csv(csv) {
+    std::fprintf(csv, "generator,dimensions,function,octaves,metric,value\n");
+  }
+
+  void write(const char* generator, const int dimensions, const char* function, const int octaves,
+             const std::string& metric, const double value) {
+    std::fprintf(csv, "%s,%d,%s,%d,%s,%.9g\n", generator, dimensions, function, octaves, metric.c_str(), value);
+  }
+
+  /// Timing and distribution of the values of one function
+  void write(const char* generator, const int dimensions, const char* function, const int octaves, const double ns,
+             const std::vector<double>& values) {
+    double min = values[0], max = values[0], sum = 0.0;
+    for (const double value : values) {
+      min = std::min(min, value);
+      max = std::max(max, value);
+      sum += value;
+    }
+    const double mean = sum / double(values.size());
+    double variance = 0.0;
+    std::vector<size_t> bins(num_bins, 0);
+    const double bin_size = (max - min) / double(num_bins);
+    for (const double value : values) {
+      variance += (value - mean) * (value - mean);
+      const size_t bin = bin_size > 0.0 ? size_t((value - min) / bin_size) : 0;
+      bins[std::min(bin, num_bins - 1)]++;
+    }
+    write(generator, dimensions, function, octaves, "ns_per_sample", ns);
+    write(generator, dimensions, function, octaves, "min", min);
+    write(generator, dimensions, function, octaves, "max", max);
+    write(generator, dimensions, function, octaves, "mean", mean);
+    write(generator, dimensions, function, octaves, "stddev", std::sqrt(variance / double(values.size())));
+    for (size_t bin = 0; bin < num_bins; bin++) {
+      char metric[32];
+      std::snprintf(metric, sizeof(metric), "histogram_%02zu", bin);
+      write(generator, dimensions, function, octaves, metric, double(bins[bin]) / double(values.size()));
+    }
+  }
+};
+
+/// Runs func(x, y) over the 2D grid, returns the nanoseconds per sample and the values
+static double run_2d(const double step, std::vector<double>& values, const std::function<double(double, double)>& func) {
+  values.resize(side_2d * side_2d);
+  const auto start = std::chrono::high_resolution_clock::now();
+  for (size_t row = 0; row < side_2d; row++) {
+    for (size_t column = 0; column < side_2d; column++) {
+      values[row * side_2d + column] = func(double(column) * step, double(row) * step);
+    }
+  }
+  const auto elapsed = std::chrono::high_resolution_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / double(values.size());
+}
+
+/// Runs func(x, y, z) over the 3D grid, returns the nanoseconds per sample and the values
+static double run_3d(const double step, std::vector<double>& values,
+                     const std::function<double(double, double, double)>& func) {
+  values.resize(width_3d * side_3d * side_3d);
+  const auto start = std::chrono::high_resolution_clock::now();
+  size_t i = 0;
+  for (size_t z = 0; z < side_3d; z++) {
+    for (size_t y = 0; y < side_3d; y++) {
+      for (size_t x = 0; x < width_3d; x++) {
+        values[i++] = func(double(x) * step, double(y) * step, double(z) * step);
+      }
+    }
+  }
+  const auto elapsed = std::chrono::high_resolution_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / double(values.size());
+}
+
+/// Runs the batched func(out) producing the 2D grid in float, returns the nanoseconds per sample and the values
+static double run_grid(std::vector<double>& values, const std::function<void(float*)>& func) {
+  std::vector<float> grid(side_2d * side_2d);
+  const auto start = std::chrono::high_resolution_clock::now();
+  func(grid.data());
+  const auto elapsed = std::chrono::high_resolution_clock::now() - start;
+  values.assign(grid.begin(), grid.end());
+  return std::chrono::duration<double, std::nano>(elapsed).count() / double(values.size());
+}
+
+/// Smallest power of two period along every axis within the tolerance, 0 if there is none up to 4096
+static double period(const size_t dimensions, const std::function<double(const double*)>& func) {
+  std::mt19937 engine(42);
+  std::uniform_real_distribution<double> coordinate(0.0, 1000.0);
+  std::vector<double> points(512 * dimensions);
+  for (auto& point : points) { point = coordinate(engine); }
+  for (double period = 1.0; period <= 4096.0; period *= 2.0) {
+    bool repeats = true;
+    for (size_t p = 0; p < points.size() && repeats; p += dimensions) {
+      const double value = func(&points[p]);
+      for (size_t axis = 0; axis < dimensions && repeats; axis++) {
+        double shifted[3] = {points[p], points[p + 1], dimensions > 2 ? points[p + 2] : 0.0};
+        shifted[axis] += period;
+        repeats = std::abs(func(shifted) - value) < 1.0e-9;
+      }
+    }
+    if (repeats) { return period; }
+  }
+  return 0.0;
+}
+
+/// Returns false if fill_grid is off from get_value
+static bool measure(const Generator& generator, Report& report) {
+  const Noise& noise = generator.noise;
+  const char* name = generator.name;
+  std::vector<double> values, reference;
+  std::printf("%s\n", name);
+
+  /// Single samples, fill_grid is checked against get_value
+  double ns = run_2d(raw_step, reference, [&](double x, double y) { return noise.get_value(x, y); });
+  report.write(name, 2, "get_value", 1, ns, reference);
+  std::printf("  2D %-18s %8.1f ns\n", "get_value", ns);
+  ns = run_grid(values, [&](float* out) {
+    noise.fill_grid(Vec2f(0.0f, 0.0f), Vec2f(float(raw_step), float(raw_step)), side_2d, side_2d, out);
+  });
+  report.write(name, 2, "fill_grid", 1, ns, values);
+  std::printf("  2D %-18s %8.1f ns\n", "fill_grid", ns);
+  double max_error = 0.0;
+  for (size_t i = 0; i < values.size(); i++) {
+    max_error = std::max(max_error, std::abs(values[i] - reference[i]));
+  }
+  report.write(name, 2, "fill_grid", 1, "max_error", max_error);
+  report.write(name, 2, "get_value", 1, "period", period(2, [&](const double* p) { return noise.get_value(p[0], p[1]); }));
+
+  /// Fractal sums, fbm and the turbulences sum octaves while the zoom halves down to 1
+  typedef std::function<double(double, double, int)> Fractal2D;
+  const std::pair<const char*, Fractal2D> fractals_2d[] = {
+    {"fbm", [&](double x, double y, int octaves) { return noise.fbm(Vec2d(x, y), std::ldexp(1.0, octaves - 1)); }},
+    {"turbulence", [&](double x, double y, int octaves) { return noise.turbulence(x, y, std::ldexp(1.0, octaves - 1)); }},
+    {"octaves", [&](double x, double y, int octaves) { return noise.octaves(x, y, octaves, 0.5); }},
+  };
+  for (const auto& fractal : fractals_2d) {
+    std::printf("  2D %-18s", fractal.first);
+    for (int octaves = 1; octaves <= max_octaves; octaves++) {
+      ns = run_2d(1.0, values, [&](double x, double y) { return fractal.second(x, y, octaves); });
+      report.write(name, 2, fractal.first, octaves, ns, values);
+      std::printf(" %8.1f", ns);
+    }
+    std::printf(" ns for 1 to %d octaves\n", max_octaves);
+  }
+  std::printf("  2D %-18s", "fbm_grid");
+  for (int octaves = 1; octaves <= max_octaves; octaves++) {
+    ns = run_grid(values, [&](float* out) {
+      noise.fbm_grid(Vec2f(0.0f, 0.0f), Vec2f(1.0f, 1.0f), side_2d, side_2d, std::ldexp(1.0, octaves - 1), out);
+    });
+    report.write(name, 2, "fbm_grid", octaves, ns, values);
+    std::printf(" %8.1f", ns);
+  }
+  std::printf(" ns for 1 to %d octaves\n", max_octaves);
+
+  if (!generator.has_3d) { return max_error < 5.0e-3; }
+
+  ns = run_3d(raw_step, values, [&](double x, double y, double z) { return noise.get_value(x, y, z); });
+  report.write(name, 3, "get_value", 1, ns, values);
+  report.write(name, 3, "get_value", 1, "period", period(3, [&](const double* p) { return noise.get_value(p[0], p[1], p[2]); }));
+  std::printf("  3D %-18s %8.1f ns\n", "get_value", ns);
+
+  typedef std::function<double(double, double, double, int)> Fractal3D;
+  const std::pair<const char*, Fractal3D> fractals_3d[] = {
+    {"fbm", [&](double x, double y, double z, int octaves) { return noise.fbm(Vec3d(x, y, z), std::ldexp(1.0, octaves - 1)); }},
+    {"turbulence", [&](double x, double y, double z, int octaves) { return noise.turbulence(x, y, z, std::ldexp(1.0, octaves - 1)); }},
+    {"turbulence_billowy", [&](double x, double y, double z, int octaves) { return noise.turbulence_billowy(x, y, z, std::ldexp(1.0, octaves - 1)); }},
+    {"turbulence_ridged", [&](double x, double y, double z, int octaves) { return noise.turbulence_ridged(x, y, z, std::ldexp(1.0, octaves - 1)); }},
+    {"octaves", [&](double x, double y, double z, int octaves) { return noise.octaves(x, y, z, octaves, 0.5); }},
+  };
+  for (const auto& fractal : fractals_3d) {
+    std::printf("  3D %-18s", fractal.first);
+    for (int octaves = 1; octaves <= max_octaves; octaves++) {
+      ns = run_3d(1.0, values, [&](double x, double y, double z) { return fractal.second(x, y, z, octaves); });
+      report.write(name, 3, fractal.first, octaves, ns, values);
+      std::printf(" %8.1f", ns);
+    }
+    std::printf(" ns for 1 to %d octaves\n", max_octaves);
+  }
+
+  /// Simplex noise with the 0.6 surflet radius is not continuous across the simplex edges, samples right on an edge
+  /// may end up in the other simplex in float precision
+  return max_error < 5.0e-3;
+}
+
+/// Octave loop of StaticFractal at run time with the same generator and float arithmetic
+template<typename G>
+static float fractal_loop(const float x, const float y, const int octaves, const bool turbulence) {
+  float total = 0.0f;
+  for (int octave = 0; octave < octaves; octave++) {
+    const float frequency = std::ldexp(1.0f, octave + 1 - octaves);
+    const float value = G::sample(x * frequency, y * frequency);
+    total += (turbulence ? std::abs(value) : value) * std::ldexp(1.0f, -octave);
+  }
+  return total;
+}
+
+/// Measures the StaticFractal of every octave count up to Octaves, returns the number of samples differing from the loop
+template<typename G, int Octaves, FractalSum Sum>
+struct StaticFractals {
+  static size_t measure(const char* name, const char* function, Report& report, std::vector<double>& ns) {
+    const size_t mismatches = StaticFractals<G, Octaves - 1, Sum>::measure(name, function, report, ns);
+    std::vector<double> values;
+    ns[Octaves - 1] = run_grid(values, [](float* out) {
+      StaticFractal<G, Octaves, std::ratio<1, 2>, Sum>::fill_grid(Vec2f(0.0f, 0.0f), Vec2f(1.0f, 1.0f), side_2d, side_2d, out);
+    });
+    report.write(name, 2, function, Octaves, ns[Octaves - 1], values);
+    size_t differing = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+      const float expected = fractal_loop<G>(float(i % side_2d), float(i / side_2d), Octaves, Sum == FractalSum::Turbulence);
+      differing += float(values[i]) != expected;
+    }
+    return mismatches + differing;
+  }
+};
+
+template<typename G, FractalSum Sum>
+struct StaticFractals<G, 0, Sum> {
+  static size_t measure(const char*, const char*, Report&, std::vector<double>&) { return 0; }
+};
+
+/// Returns false if a StaticFractal differs from the octave loop
+template<typename G>
+static bool measure_static(const char* name, Report& report) {
+  std::vector<double> values;
+  std::printf("%s\n", name);
+  double ns = run_grid(values, [](float* out) {
+    NoiseLanes::fill_grid_lanes(G(), Vec2f(0.0f, 0.0f), Vec2f(float(raw_step), float(raw_step)), side_2d, side_2d, out);
+  });
+  report.write(name, 2, "fill_grid", 1, ns, values);
+  std::printf("  2D %-18s %8.1f ns\n", "fill_grid", ns);
+
+  std::vector<double> timings(max_octaves);
+  size_t mismatches = 0;
+  const std::pair<const char*, FractalSum> sums[] = {{"static_fbm", FractalSum::Fbm}, {"static_turbulence", FractalSum::Turbulence}};
+  for (const auto& sum : sums) {
+    if (sum.second == FractalSum::Fbm) {
+      mismatches += StaticFractals<G, max_octaves, FractalSum::Fbm>::measure(name, sum.first, report, timings);
+    } else {
+      mismatches += StaticFractals<G, max_octaves, FractalSum::Turbulence>::measure(name, sum.first, report, timings);
+    }
+    std::printf("  2D %-18s", sum.first);
+    for (const double timing : timings) { std::printf(" %8.1f", timing); }
+    std::printf(" ns for 1 to %d octaves\n", max_octaves);
+  }
+  return mismatches == 0;
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "noise_benchmark.csv";
+  std::FILE* csv = std::fopen(path, "w");
+  if (!csv) {
+    std::printf("Could not open %s\n", path);
+    return EXIT_FAILURE;
+  }
+#if defined(__AVX2__)
+  std::printf("fill_grid: AVX2, 8 samples at a time\n");
+#else
+  std::printf("fill_grid: scalar float\n");
+#endif
+
+  const Perlin perlin(1337);
+  const Perlin_Improved perlin_improved(1337);
+  const Simplex_Patent simplex_patent(1337);
+  const Simplex_Tables simplex_tables(1337);
+  const Generator generators[] = {
+    {"Perlin", perlin, true},
+    {"Perlin_Improved", perlin_improved, true},
+    {"Simplex_Patent", simplex_patent, true},
+    {"Simplex_Tables", simplex_tables, false},
+  };
+
+  Report report(csv);
+  bool accurate = true;
+  for (const Generator& generator : generators) {
+    accurate &= measure(generator, report);
+  }
+  accurate &= measure_static<StaticPerlin<1337>>("StaticPerlin", report);
+  accurate &= measure_static<StaticPerlinImproved<1337>>("StaticPerlinImproved", report);
+  std::fclose(csv);
+  std::printf("Results written to %s\n", path);
+  if (!accurate) { std::printf("fill_grid differs from get_value or a StaticFractal from its octave loop\n"); }
+  return accurate ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,115 @@
+/// Fills the SpatialHash with transforms scattered over a terrain sized area, moves a fraction of them each frame and
+/// measures the update and the radius and box queries against a linear scan over all the positions.
+/// Exits with EXIT_FAILURE if a query result differs from the linear scan.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../nodes/entitysystem.h"
+#include "../nodes/spatialhash.h"
+#include "../nodes/transform.h"
+#include "../util/jobsystem.h"
+
+int main() {
+  const size_t num_entities = 100000;
+  const size_t num_moved = num_entities / 10;
+  const size_t num_frames = 100;
+  const size_t num_queries = 1000;
+  const float extent = 512.0f;
+  const float radius = 8.0f;
+
+  auto& transforms = TransformSystem::instance();
+  auto& grid = SpatialHash::instance();
+  grid.set_cell_size(2.0f * radius); // A query then overlaps 8 to 27 cells
+  JobSystem::instance();
+
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> coordinate(0.0f, extent);
+  std::uniform_real_distribution<float> height(0.0f, 64.0f);
+  std::vector<ID> ids(num_entities);
+  std::vector<Vec3f> positions(num_entities);
+  transforms.reserve(num_entities);
+  for (size_t i = 0; i < num_entities; i++) {
+    ids[i] = EntitySystem::instance().new_entity();
+    positions[i] = Vec3f(coordinate(rng), height(rng), coordinate(rng));
+    TransformComponent component;
+    component.position = positions[i];
+    transforms.add_component(component, ids[i]);
+  }
+  transforms.compose_dirty();
+  grid.update(transforms);
+  transforms.reset_dirty();
+
+  using namespace std::chrono;
+  double update_ms = 0.0;
+  std::uniform_int_distribution<size_t> entity(0, num_entities - 1);
+  std::vector<ID> moved(num_moved);
+  std::vector<Vec3f> moved_positions(num_moved);
+  for (size_t frame = 0; frame < num_frames; frame++) {
+    for (size_t i = 0; i < num_moved; i++) {
+      const size_t idx = entity(rng);
+      positions[idx] = Vec3f(coordinate(rng), height(rng), coordinate(rng));
+      moved[i] = ids[idx];
+      moved_positions[i] = positions[idx];
+    }
+    transforms.set_positions(moved.data(), moved_positions.data(), num_moved);
+    transforms.compose_dirty();
+    const auto start = high_resolution_clock::now();
+    grid.update(transforms);
+    update_ms += duration<double, std::milli>(high_resolution_clock::now() - start).count();
+    transforms.reset_dirty();
+  }
+
+  std::vector<Vec3f> centers(num_queries);
+  for (auto& center : centers) {
+    center = Vec3f(coordinate(rng), height(rng), coordinate(rng));
+  }
+
+  std::vector<ID> found;
+  size_t num_found = 0;
+  auto start = high_resolution_clock::now();
+  for (const auto& center : centers) {
+    found.clear();
+    grid.query_radius(center, radius, found);
+    num_found += found.size();
+  }
+  const double radius_ms = duration<double, std::milli>(high_resolution_clock::now() - start).count();
+
+  start = high_resolution_clock::now();
+  for (const auto& center : centers) {
+    found.clear();
+    grid.query_aabb(center - Vec3f(radius), center + Vec3f(radius), found);
+  }
+  const double aabb_ms = duration<double, std::milli>(high_resolution_clock::now() - start).count();
+
+  /// Linear scan over all the positions for comparison, also checks the results
+  bool matches = true;
+  std::vector<ID> expected;
+  start = high_resolution_clock::now();
+  for (const auto& center : centers) {
+    expected.clear();
+    for (size_t i = 0; i < num_entities; i++) {
+      const Vec3f d = positions[i] - center;
+      if (d.x * d.x + d.y * d.y + d.z * d.z <= radius * radius) { expected.push_back(ids[i]); }
+    }
+    found.clear();
+    grid.query_radius(center, radius, found);
+    std::sort(expected.begin(), expected.end());
+    std::sort(found.begin(), found.end());
+    matches &= found == expected;
+  }
+  const double linear_ms = duration<double, std::milli>(high_resolution_clock::now() - start).count();
+
+  std::printf("workers: %zu, entities: %zu, cells: %zu, cell size: %.1f\n", JobSystem::instance().num_workers(),
+              grid.size(), grid.num_cells(), grid.get_cell_size());
+  std::printf("update: %.3f ms / frame for %zu moved entities\n", update_ms / num_frames, num_moved);
+  std::printf("radius %.1f: %.2f us / query, %.1f entities found on average\n", radius, 1000.0 * radius_ms / num_queries,
+              double(num_found) / num_queries);
+  std::printf("aabb: %.2f us / query\n", 1000.0 * aabb_ms / num_queries);
+  std::printf("linear scan: %.2f us / query\n", 1000.0 * linear_ms / num_queries);
+  if (!matches) { std::printf("Query results differ from the linear scan\n"); }
+  return matches ? EXIT_SUCCESS : EXIT_FAILURE;
+}
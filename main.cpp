@@ -9,8 +9,11 @@
 #include "scene/world.hpp"
 #include "render/debug_opengl.h"
 #include "nodes/skybox.h"
+#include "nodes/entitycommands.h"
 #include "scene/world.hpp"
 #include "render/graphicsbatch.h"
+#include "util/taskgraph.h"
+#include "util/simulationthread.h"
 
 struct Resolution {
   int width, height;
@@ -66,6 +69,46 @@ int main() {
   /// Delta values
   const int num_deltas = 100;
   float deltas[num_deltas];
+
+  /// Per worker fraction of the last frame spent running jobs
+  std::vector<float> worker_utilisation;
+
+  /// Simulation systems of a frame, independent systems run concurrently
+  uint64_t sim_frame = 0;
+  int64_t sim_delta = 0;
+  TaskGraph frame_graph;
+  frame_graph.add_system("Actions", {ComponentType::Action}, {ComponentType::Transform}, [&]() {
+    ActionSystem::instance().execute_actions(sim_frame, sim_delta);
+  });
+  frame_graph.add_system("Animations", {ComponentType::Animation}, {ComponentType::Animation, ComponentType::Transform}, [&]() {
+    AnimationSystem::instance().update(float(sim_delta) / 1000.0f);
+  });
+  frame_graph.add_system("Compose transforms", {ComponentType::Transform}, {ComponentType::Transform}, [&]() {
+    TransformSystem::instance().compose_dirty();
+  });
+  frame_graph.add_system("World", {}, {ComponentType::World}, [&]() {
+    world.tick();
+  });
+  frame_graph.add_system("Spatial hash", {ComponentType::Transform}, {ComponentType::Spatial}, [&]() {
+    SpatialHash::instance().update(TransformSystem::instance());
+  });
+  /// Resets the transform journal, thus declared as writing the transforms to run after the other readers of it
+  frame_graph.add_system("Render transforms", {ComponentType::Transform}, {ComponentType::Render, ComponentType::Transform}, [&]() {
+    renderer.update_transforms();
+  });
+
+  /// Frame N+1 is simulated on its own thread while frame N is rendered from the snapshots of the graphics batches
+  SimulationThread simulation([&](const uint64_t frame, const int64_t delta) {
+    sim_frame = frame;
+    sim_delta = delta;
+    frame_graph.execute();
+  });
+
+  /// Copied at the hand-off since the UI is drawn while the next frame is simulated
+  TaskGraph::FrameStats frame_stats;
+  double simulation_ms = 0.0;
+  bool apply_job_config = false;
+  JobSystemConfig job_config = JobSystem::instance().get_config();
   
   while (!DONE) {
       current_tick = std::chrono::high_resolution_clock::now();
@@ -145,18 +188,27 @@ int main() {
           break;
       }
     }
-    renderer.camera->position = renderer.camera->update(delta);
-
-    /// Run all actions
-    ActionSystem::instance().execute_actions(renderer.state.frame, delta);
-
-    /// Let the game do its thing
-    world.tick();
+    /// Single synchronisation point of the frame, publishes the simulated frame and starts simulating the next one
+    simulation.hand_off(delta, [&]() {
+      renderer.swap_snapshots();
+      MainThreadQueue::instance().execute_all(); // Stages of async pipelines that touch GL or the engine systems
+      EntityCommands::instance().apply_all();    // Entities spawned and destroyed from any thread
+      renderer.execute_gl_commands();
+      renderer.compact_batches();
+      frame_stats = frame_graph.get_stats();
+      simulation_ms = simulation.get_simulation_ms();
+      if (apply_job_config) {
+        JobSystem::instance().configure(job_config);
+        apply_job_config = false;
+      }
+    });
 
     /// Render the world
+    renderer.camera->position = renderer.camera->update(delta);
     renderer.render(delta);
 
     /// ImGui - Debug instruments
+    JobSystem::instance().sample_utilisation(worker_utilisation);
     {
       ImGui_ImplSdlGL3_NewFrame(window);
       auto io = ImGui::GetIO();
@@ -165,17 +217,65 @@ int main() {
       if (ImGui::CollapsingHeader("Render System", ImGuiTreeNodeFlags_DefaultOpen)) {
         ImGui::Text("Frame: %llu", renderer.state.frame);
         ImGui::Text("Entities: %llu", renderer.state.entities);
+        ImGui::Text("GL commands: %llu run in %.2f ms, %llu queued", renderer.state.gl_commands_executed,
+                    renderer.state.gl_commands_ms, renderer.state.gl_commands_backlog);
+        float gl_command_budget_ms = float(renderer.gl_command_budget_ms);
+        if (ImGui::SliderFloat("GL budget (ms)", &gl_command_budget_ms, 0.0f, 16.0f)) {
+          renderer.gl_command_budget_ms = gl_command_budget_ms;
+        }
         ImGui::Text("Average %lld ms / frame (%.1f FPS)", delta, io.Framerate);
 
         static size_t i = -1; i = (i + 1) % num_deltas;
         deltas[i] = float(delta);
         ImGui::PlotLines("", deltas, num_deltas, 0, "ms / frame", 0.0f, 50.0f, ImVec2(ImGui::GetWindowWidth(), 100));
 
+        if (ImGui::CollapsingHeader("Frame task graph")) {
+          ImGui::Text("Simulation: %.2f ms, render thread waited %.2f ms", simulation_ms, simulation.get_hand_off_wait_ms());
+          ImGui::Text("Systems: %.2f ms (critical path %.2f ms)", frame_stats.frame_ms, frame_stats.critical_path_ms);
+          std::string critical_path;
+          for (const auto idx : frame_stats.critical_path) {
+            critical_path += (critical_path.empty() ? "" : " -> ") + frame_graph.get_systems()[idx]->name;
+          }
+          ImGui::TextWrapped("Critical path: %s", critical_path.c_str());
+          for (size_t i = 0; i < frame_stats.start_ms.size(); i++) {
+            ImGui::Text("%s: start %.3f ms, took %.3f ms", frame_graph.get_systems()[i]->name.c_str(), frame_stats.start_ms[i], frame_stats.duration_ms[i]);
+          }
+        }
+
+        if (ImGui::CollapsingHeader("Job system")) {
+          auto& job_system = JobSystem::instance();
+          static int num_workers = int(job_config.num_workers);
+          ImGui::Text("Workers: %zu, hardware threads: %u, main thread CPU: %d", job_system.num_workers(),
+                      std::thread::hardware_concurrency(), job_system.get_main_thread_cpu());
+          ImGui::SliderInt("Workers (0 = auto)", &num_workers, 0, int(std::thread::hardware_concurrency()));
+          ImGui::Checkbox("Reserve main thread core", &job_config.reserve_main_thread_core);
+          ImGui::Checkbox("Pin threads to cores", &job_config.pin_threads);
+          ImGui::Checkbox("SMT aware placement", &job_config.smt_aware);
+          if (ImGui::Button("Apply")) {
+            /// Workers are only restarted at the hand-off, while the simulation is not using them
+            job_config.num_workers = size_t(num_workers);
+            apply_job_config = true;
+          }
+          for (size_t i = 0; i < worker_utilisation.size() && i < job_system.num_workers(); i++) {
+            const std::string label = "Worker #" + std::to_string(i) + " (CPU " + std::to_string(job_system.worker_cpu(i)) + ")";
+            ImGui::ProgressBar(worker_utilisation[i], ImVec2(-1, 0), label.c_str());
+          }
+        }
+
         if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen)) {
           ImGui::InputFloat3("Position", &renderer.camera->position.x);
           ImGui::InputFloat3("Direction", &renderer.camera->direction.x);
         }
 
+        if (ImGui::CollapsingHeader("Archetypes")) {
+          for (const auto& archetype : ArchetypeStorage::instance().get_archetypes()) {
+            if (archetype.size == 0) { continue; }
+            ImGui::Text("Mask %#llx: %llu entities in %llu chunks of %llu", (unsigned long long)archetype.mask,
+                        (unsigned long long)archetype.size, (unsigned long long)archetype.chunks.size(),
+                        (unsigned long long)archetype.capacity);
+          }
+        }
+
         if (ImGui::CollapsingHeader("Graphics batches")) {
           ImGui::Text("Graphics batches: %llu", renderer.state.graphic_batches);
           for (size_t batch_num = 0; batch_num < renderer.graphics_batches.size(); batch_num++) {
@@ -184,9 +284,9 @@ int main() {
             if (ImGui::CollapsingHeader(batch_title.c_str())) {
               ImGui::Text("Size: %llu", batch.entity_ids.size());
               if (ImGui::CollapsingHeader("Members")) {
-                for (const auto& id : batch.entity_ids) {
-                  ImGui::Text("Entity id: %llu", id);
-                  Vec3f position = TransformSystem::instance().lookup(id).matrix.get_translation();
+                for (size_t i = 0; i < batch.entity_ids.size(); i++) {
+                  ImGui::Text("Entity id: %llu", batch.entity_ids[i]);
+                  Vec3f position = batch.snapshot_transforms[i].matrix.get_translation();
                   ImGui::InputFloat3("Position", &position.x);
                 }
               }
@@ -201,6 +301,7 @@ int main() {
     }
     SDL_GL_SwapWindow(window);
   }
+  simulation.stop();
   JobSystem::instance().wait_on_all();
   ImGui_ImplSdlGL3_Shutdown();
   SDL_GL_DeleteContext(context);
@@ -9,11 +9,160 @@
 #include <stdint.h>
 #include <array>
 #include <numeric>
+#include <ratio>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Float copies of the 2D tables of a noise generator for the batched evaluation
+ * - Permutations widened to 32 bits for the AVX2 gathers and repeated once so that perms[i + perms[j]] never wraps
+ * - Gradients as structure of arrays, indexed by the permutation values
+ */
+struct NoiseTable2D {
+    std::array<int32_t, 512> perms;
+    std::array<float, 256> grad_x;
+    std::array<float, 256> grad_y;
+
+    NoiseTable2D(): perms(), grad_x(), grad_y() {}
+
+    void set(const std::vector<uint8_t>& permutations, const std::vector<Vec2<double>>& grads) {
+        for (size_t i = 0; i < perms.size(); i++) { perms[i] = permutations[i % permutations.size()]; }
+        for (size_t i = 0; i < grads.size() && i < grad_x.size(); i++) {
+            grad_x[i] = float(grads[i].x);
+            grad_y[i] = float(grads[i].y);
+        }
+    }
+};
+
+/**
+ * Float and AVX2 building blocks of the batched noise evaluation, shared by the Noise subclasses and the compile-time
+ * pipelines
+ */
+struct NoiseLanes {
+    /// Tables have 256 entries, hashed lattice coordinates wrap around with a mask
+    static const int32_t hash_mask = 255;
+
+    static inline float smoothstep(float t) { return t * t * (3.0f - 2.0f * t); }
+    static inline float fade(float t) { return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f); }
+    static inline float lerp(float t, float a, float b) { return (1.0f - t) * a + t * b; }
+
+    /// fill_grid for generators with float sample(x, y) and, with AVX2, __m256 sample8(x, y) doing the same operations
+    /// on eight samples; the samples of a row are split into lanes of eight and a scalar tail
+    template<typename N>
+    static void fill_grid_lanes(const N& noise, const Vec2f& origin, const Vec2f& step, size_t width, size_t height, float* out) {
+        for (size_t row = 0; row < height; row++) {
+            const float y = origin.y + float(row) * step.y;
+            float* samples = out + row * width;
+            size_t column = 0;
+#if defined(__AVX2__)
+            const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+            const __m256 ys = _mm256_set1_ps(y);
+            const __m256 origin_x = _mm256_set1_ps(origin.x);
+            const __m256 step_x = _mm256_set1_ps(step.x);
+            const size_t vector_width = width - width % 8;
+            for (; column < vector_width; column += 8) {
+                const __m256 columns = _mm256_add_ps(_mm256_set1_ps(float(column)), lanes);
+                const __m256 xs = _mm256_add_ps(origin_x, _mm256_mul_ps(columns, step_x));
+                _mm256_storeu_ps(samples + column, noise.sample8(xs, ys));
+            }
+#endif
+            for (; column < width; column++) {
+                samples[column] = noise.sample(origin.x + float(column) * step.x, y);
+            }
+        }
+    }
+
+    /// 2D gradient noise on the integer lattice in float precision, the smoothstep (Perlin) or fade (Perlin_Improved)
+    /// interpolated dot products of the gradients of the four corners
+    /// Table is a NoiseTable2D or a StaticNoiseTable2D, anything with the perms, grad_x and grad_y arrays
+    template<bool Fade, typename Table>
+    static float lattice_sample(const Table& table, float X, float Y) {
+        X += 0.1f; Y += 0.1f; // Skew coordinates to avoid integer lines becoming zero
+        const float x0 = std::floor(X), y0 = std::floor(Y);
+        const float x1 = std::ceil(X), y1 = std::ceil(Y);
+
+        const int32_t hy0 = table.perms[int32_t(y0) & hash_mask];
+        const int32_t hy1 = table.perms[int32_t(y1) & hash_mask];
+        const int32_t h00 = table.perms[(int32_t(x0) + hy0) & hash_mask];
+        const int32_t h10 = table.perms[(int32_t(x1) + hy0) & hash_mask];
+        const int32_t h01 = table.perms[(int32_t(x0) + hy1) & hash_mask];
+        const int32_t h11 = table.perms[(int32_t(x1) + hy1) & hash_mask];
+
+        const float dx0 = X - x0, dx1 = X - x1;
+        const float dy0 = Y - y0, dy1 = Y - y1;
+        const float d00 = table.grad_x[h00] * dx0 + table.grad_y[h00] * dy0;
+        const float d10 = table.grad_x[h10] * dx1 + table.grad_y[h10] * dy0;
+        const float d01 = table.grad_x[h01] * dx0 + table.grad_y[h01] * dy1;
+        const float d11 = table.grad_x[h11] * dx1 + table.grad_y[h11] * dy1;
+
+        const float wx = Fade ? fade(dx0) : smoothstep(dx0);
+        const float wy = Fade ? fade(dy0) : smoothstep(dy0);
+        return lerp(wy, lerp(wx, d00, d10), lerp(wx, d01, d11));
+    }
+
+#if defined(__AVX2__)
+    static inline __m256 smoothstep(__m256 t) {
+        return _mm256_mul_ps(_mm256_mul_ps(t, t), _mm256_sub_ps(_mm256_set1_ps(3.0f), _mm256_mul_ps(_mm256_set1_ps(2.0f), t)));
+    }
+
+    static inline __m256 fade(__m256 t) {
+        const __m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f))), _mm256_set1_ps(10.0f));
+        return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+    }
+
+    static inline __m256 lerp(__m256 t, __m256 a, __m256 b) {
+        return _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), t), a), _mm256_mul_ps(t, b));
+    }
+
+    /// a * b + c * d
+    static inline __m256 dot(__m256 a, __m256 b, __m256 c, __m256 d) {
+        return _mm256_add_ps(_mm256_mul_ps(a, b), _mm256_mul_ps(c, d));
+    }
+
+    /// table[idxs & hash_mask]
+    static inline __m256i hash(const int32_t* table, __m256i idxs) {
+        return _mm256_i32gather_epi32(table, _mm256_and_si256(idxs, _mm256_set1_epi32(hash_mask)), 4);
+    }
+
+    /// lattice_sample of eight samples, the lookups into the tables are gathers
+    template<bool Fade, typename Table>
+    static __m256 lattice_sample8(const Table& table, __m256 X, __m256 Y) {
+        X = _mm256_add_ps(X, _mm256_set1_ps(0.1f));
+        Y = _mm256_add_ps(Y, _mm256_set1_ps(0.1f));
+        const __m256 x0 = _mm256_floor_ps(X), y0 = _mm256_floor_ps(Y);
+        const __m256 x1 = _mm256_ceil_ps(X), y1 = _mm256_ceil_ps(Y);
+
+        const int32_t* perms = &table.perms[0];
+        const __m256i hy0 = hash(perms, _mm256_cvttps_epi32(y0));
+        const __m256i hy1 = hash(perms, _mm256_cvttps_epi32(y1));
+        const __m256i h00 = hash(perms, _mm256_add_epi32(_mm256_cvttps_epi32(x0), hy0));
+        const __m256i h10 = hash(perms, _mm256_add_epi32(_mm256_cvttps_epi32(x1), hy0));
+        const __m256i h01 = hash(perms, _mm256_add_epi32(_mm256_cvttps_epi32(x0), hy1));
+        const __m256i h11 = hash(perms, _mm256_add_epi32(_mm256_cvttps_epi32(x1), hy1));
+
+        const float* gx = &table.grad_x[0];
+        const float* gy = &table.grad_y[0];
+        const __m256 dx0 = _mm256_sub_ps(X, x0), dx1 = _mm256_sub_ps(X, x1);
+        const __m256 dy0 = _mm256_sub_ps(Y, y0), dy1 = _mm256_sub_ps(Y, y1);
+        const __m256 d00 = dot(_mm256_i32gather_ps(gx, h00, 4), dx0, _mm256_i32gather_ps(gy, h00, 4), dy0);
+        const __m256 d10 = dot(_mm256_i32gather_ps(gx, h10, 4), dx1, _mm256_i32gather_ps(gy, h10, 4), dy0);
+        const __m256 d01 = dot(_mm256_i32gather_ps(gx, h01, 4), dx0, _mm256_i32gather_ps(gy, h01, 4), dy1);
+        const __m256 d11 = dot(_mm256_i32gather_ps(gx, h11, 4), dx1, _mm256_i32gather_ps(gy, h11, 4), dy1);
+
+        const __m256 wx = Fade ? fade(dx0) : smoothstep(dx0);
+        const __m256 wy = Fade ? fade(dy0) : smoothstep(dy0);
+        return lerp(wy, lerp(wx, d00, d10), lerp(wx, d01, d11));
+    }
+#endif
+};
 
 /**
  * Base class for noise generating classes
  */
-class Noise {
+class Noise : protected NoiseLanes {
 public:
     /// 2D raw noise from the underlying noise algorithm
     virtual double get_value(double x, double y) const = 0;
@@ -21,6 +170,32 @@ public:
     /// 3D raw noise from the underlying noise algorithm
     virtual double get_value(double x, double y, double z) const = 0;
 
+    /// 2D raw noise of a grid of width * height samples in float precision, row major into out
+    /// Sample (column, row) is taken at origin + (column, row) * step. Subclasses evaluate eight samples at a time
+    /// with AVX2, this fallback calls get_value for each sample.
+    virtual void fill_grid(const Vec2f& origin, const Vec2f& step, size_t width, size_t height, float* out) const {
+        for (size_t row = 0; row < height; row++) {
+            const float y = origin.y + float(row) * step.y;
+            for (size_t column = 0; column < width; column++) {
+                const float x = origin.x + float(column) * step.x;
+                out[row * width + column] = float(get_value(x, y));
+            }
+        }
+    }
+
+    /// 2D fBm of a grid in float precision, the same as fbm(Vec2<double>, zoom_factor) for every sample of fill_grid
+    void fbm_grid(const Vec2f& origin, const Vec2f& step, size_t width, size_t height, double zoom_factor, float* out) const {
+        const size_t count = width * height;
+        std::fill(out, out + count, 0.0f);
+        std::vector<float> octave(count);
+        for (double zoom = zoom_factor; zoom >= 1.0; zoom /= 2) {
+            const float scale = float(1.0 / zoom);
+            fill_grid(Vec2f(origin.x * scale, origin.y * scale), Vec2f(step.x * scale, step.y * scale), width, height, octave.data());
+            for (size_t i = 0; i < count; i++) { out[i] += octave[i] * float(zoom); }
+        }
+        for (size_t i = 0; i < count; i++) { out[i] /= float(zoom_factor); }
+    }
+
     /// 3D turbulence noise which simulates fBm
     double turbulence(double x, double y, double zoom_factor) const {
         double value = 0;
@@ -160,6 +335,10 @@ protected:
 
     /// Linear interpolation between a and b with t as a variable
     static inline double lerp(double t, double a, double b) { return (1 - t) * a + t * b; }
+
+    using NoiseLanes::smoothstep;
+    using NoiseLanes::fade;
+    using NoiseLanes::lerp;
 };
 
 /**
@@ -198,7 +377,7 @@ public:
 
     /// Given a coordinate (i, j) selects the B'th bit
     uint8_t b(int i, int j, int B) const {
-        auto bit_index = 2*(i & (0b1 << B)) + (j & (0b1 << B));
+        auto bit_index = 2 * bit(i, B) + bit(j, B); // The bits are 0 or 1, masked values indexed past bit_patterns
         return bit_patterns[bit_index];
     }
 
@@ -250,17 +429,17 @@ public:
         const double radius = 0.6 * 0.6; // Radius of the surflet circle (0.6 in patent)
         double sum = 0.0;
 
-        double t0 = radius - vertex_a.length()*vertex_a.length();
+        double t0 = radius - vertex_a.squared_length();
         if (t0 > 0) {
             sum += std::pow(t0, 4) * grad_a.dot(vertex_a);
         }
 
-        double t1 = radius - vertex_b.length()*vertex_b.length();
+        double t1 = radius - vertex_b.squared_length();
         if (t1 > 0) {
             sum += std::pow(t1, 4) * grad_b.dot(vertex_b);
         }
 
-        double t2 = radius - vertex_c.length()*vertex_c.length();
+        double t2 = radius - vertex_c.squared_length();
         if (t2 > 0) {
             sum += std::pow(t2, 4) * grad_c.dot(vertex_c);
         }
@@ -346,7 +525,7 @@ public:
     double kernel(Vec3<double> uvw, Vec3<double> ijk, Vec3<double> vertex) const {
         double sum = 0.0;
         Vec3<double> rel = uvw - vertex; // Relative simplex cell vertex
-        double t = 0.6 - rel.length()*rel.length(); // 0.6 - x*x - y*y - z*z
+        double t = 0.6 - rel.squared_length(); // 0.6 - x*x - y*y - z*z
         if (t > 0) {
             Vec3<double> pqr = grad(ijk + vertex, rel); // Generate gradient vector for vertex
             t *= t;
@@ -427,9 +606,12 @@ class Simplex_Tables : public Noise {
 
     /// Permutation table for indices to the gradients
     std::vector<uint8_t> perms;
+
+    /// Float tables for fill_grid
+    NoiseTable2D table;
 public:
     /// Perms size is double that of grad to avoid index wrapping
-    Simplex_Tables(uint64_t seed): engine(seed), grads2(256), grads3(256), distr(-1.0, 1.0), perms(256) {
+    Simplex_Tables(uint64_t seed): engine(seed), grads2(256), grads3(256), distr(-1.0, 1.0), perms(512) {
         /// Fill the gradients list with random normalized vectors
         for (int i = 0; i < grads2.size(); i++) {
             double x = distr(engine);
@@ -442,11 +624,13 @@ public:
         }
 
         /// Fill gradient lookup array with random indices to the gradients list
-        /// Fill with indices from 0 to perms.size()
-        std::iota(perms.begin(), perms.end(), 0);
+        /// Fill with indices from 0 to grads2.size(), repeated in the upper half
+        std::iota(perms.begin(), perms.begin() + 256, 0);
 
         /// Randomize the order of the indices
-        std::shuffle(perms.begin(), perms.end(), engine);
+        std::shuffle(perms.begin(), perms.begin() + 256, engine);
+        std::copy(perms.begin(), perms.begin() + 256, perms.begin() + 256);
+        table.set(perms, grads2);
     }
 
     double get_value(double x, double y) const override {
@@ -473,8 +657,8 @@ public:
         Vec2<double> vertex_b{vertex_a.x - x_step + G, vertex_a.y - y_step + G};
         Vec2<double> vertex_c{vertex_a.x - 1.0 + 2.0 * G, vertex_a.y - 1.0 + 2.0 * G};
 
-        auto ii = i % 255; // FIXME: Bit mask instead? Measure speedup
-        auto jj = j % 255;
+        auto ii = i & hash_mask;
+        auto jj = j & hash_mask;
         auto grad_a = grads2[perms[ii + perms[jj]]];
         auto grad_b = grads2[perms[ii + x_step + perms[jj + y_step]]];
         auto grad_c = grads2[perms[ii + 1 + perms[jj + 1]]];
@@ -483,17 +667,17 @@ public:
         const double radius = 0.6; // Radius of the surflet circle (0.6 in patent)
         double sum = 0.0;
 
-        double t0 = radius - vertex_a.length()*vertex_a.length();
+        double t0 = radius - vertex_a.squared_length();
         if (t0 > 0) {
             sum += 8 * std::pow(t0, 4) * grad_a.dot(vertex_a);
         }
 
-        double t1 = radius - vertex_b.length()*vertex_b.length();
+        double t1 = radius - vertex_b.squared_length();
         if (t1 > 0) {
             sum += 8 * std::pow(t1, 4) * grad_b.dot(vertex_b);
         }
 
-        double t2 = radius - vertex_c.length()*vertex_c.length();
+        double t2 = radius - vertex_c.squared_length();
         if (t2 > 0) {
             sum += 8 * std::pow(t2, 4) * grad_c.dot(vertex_c);
         }
@@ -503,6 +687,90 @@ public:
 
     // TODO: Implement
     double get_value(double x, double y, double z) const override { exit(EXIT_FAILURE); }
+
+    /// get_value in float precision
+    float sample(float x, float y) const {
+        const float F = 0.366025403f; // (sqrt(3) - 1) / 2
+        const float G = 0.211324865f; // (3 - sqrt(3)) / 6
+        const float s = (x + y) * F;
+        const float i = std::floor(x + s);
+        const float j = std::floor(y + s);
+        const float t = (i + j) * G;
+        const float ax = x - (i - t);
+        const float ay = y - (j - t);
+
+        const int32_t x_step = ax > ay ? 1 : 0; // Lower triangle
+        const int32_t y_step = 1 - x_step;
+        const float bx = ax - float(x_step) + G, by = ay - float(y_step) + G;
+        const float cx = ax + (2.0f * G - 1.0f), cy = ay + (2.0f * G - 1.0f);
+
+        const int32_t ii = int32_t(i) & hash_mask;
+        const int32_t jj = int32_t(j) & hash_mask;
+        const int32_t ha = table.perms[ii + table.perms[jj]];
+        const int32_t hb = table.perms[ii + x_step + table.perms[jj + y_step]];
+        const int32_t hc = table.perms[ii + 1 + table.perms[jj + 1]];
+        return surflet(ha, ax, ay) + surflet(hb, bx, by) + surflet(hc, cx, cy);
+    }
+
+#if defined(__AVX2__)
+    /// sample of eight samples
+    __m256 sample8(__m256 x, __m256 y) const {
+        const __m256 F = _mm256_set1_ps(0.366025403f);
+        const __m256 G = _mm256_set1_ps(0.211324865f);
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 s = _mm256_mul_ps(_mm256_add_ps(x, y), F);
+        const __m256 i = _mm256_floor_ps(_mm256_add_ps(x, s));
+        const __m256 j = _mm256_floor_ps(_mm256_add_ps(y, s));
+        const __m256 t = _mm256_mul_ps(_mm256_add_ps(i, j), G);
+        const __m256 ax = _mm256_sub_ps(x, _mm256_sub_ps(i, t));
+        const __m256 ay = _mm256_sub_ps(y, _mm256_sub_ps(j, t));
+
+        const __m256 x_step = _mm256_and_ps(_mm256_cmp_ps(ax, ay, _CMP_GT_OQ), one); // Lower triangle
+        const __m256 y_step = _mm256_sub_ps(one, x_step);
+        const __m256 bx = _mm256_add_ps(_mm256_sub_ps(ax, x_step), G);
+        const __m256 by = _mm256_add_ps(_mm256_sub_ps(ay, y_step), G);
+        const __m256 c = _mm256_set1_ps(2.0f * 0.211324865f - 1.0f);
+        const __m256 cx = _mm256_add_ps(ax, c), cy = _mm256_add_ps(ay, c);
+
+        const int32_t* perms = table.perms.data();
+        const __m256i ones = _mm256_set1_epi32(1);
+        const __m256i ii = _mm256_and_si256(_mm256_cvttps_epi32(i), _mm256_set1_epi32(hash_mask));
+        const __m256i jj = _mm256_and_si256(_mm256_cvttps_epi32(j), _mm256_set1_epi32(hash_mask));
+        const __m256i x_steps = _mm256_cvttps_epi32(x_step);
+        const __m256i y_steps = _mm256_cvttps_epi32(y_step);
+        const __m256i pa = _mm256_i32gather_epi32(perms, jj, 4);
+        const __m256i pb = _mm256_i32gather_epi32(perms, _mm256_add_epi32(jj, y_steps), 4);
+        const __m256i pc = _mm256_i32gather_epi32(perms, _mm256_add_epi32(jj, ones), 4);
+        const __m256i ha = _mm256_i32gather_epi32(perms, _mm256_add_epi32(ii, pa), 4);
+        const __m256i hb = _mm256_i32gather_epi32(perms, _mm256_add_epi32(_mm256_add_epi32(ii, x_steps), pb), 4);
+        const __m256i hc = _mm256_i32gather_epi32(perms, _mm256_add_epi32(_mm256_add_epi32(ii, ones), pc), 4);
+        return _mm256_add_ps(_mm256_add_ps(surflet(ha, ax, ay), surflet(hb, bx, by)), surflet(hc, cx, cy));
+    }
+#endif
+
+    void fill_grid(const Vec2f& origin, const Vec2f& step, size_t width, size_t height, float* out) const override {
+        fill_grid_lanes(*this, origin, step, width, height, out);
+    }
+
+private:
+    /// Contribution of the vertex within the surflet circle of radius 0.6 (as in the patent)
+    float surflet(int32_t grad, float x, float y) const {
+        float t = 0.6f - (x * x + y * y);
+        t = t > 0.0f ? t : 0.0f;
+        const float t2 = t * t;
+        return 8.0f * (t2 * t2) * (table.grad_x[grad] * x + table.grad_y[grad] * y);
+    }
+
+#if defined(__AVX2__)
+    __m256 surflet(__m256i grad, __m256 x, __m256 y) const {
+        __m256 t = _mm256_sub_ps(_mm256_set1_ps(0.6f), dot(x, x, y, y));
+        t = _mm256_max_ps(t, _mm256_setzero_ps());
+        const __m256 t2 = _mm256_mul_ps(t, t);
+        const __m256 gradient = dot(_mm256_i32gather_ps(table.grad_x.data(), grad, 4), x,
+                                    _mm256_i32gather_ps(table.grad_y.data(), grad, 4), y);
+        return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(8.0f), _mm256_mul_ps(t2, t2)), gradient);
+    }
+#endif
 };
 
 /**
@@ -530,6 +798,9 @@ class Perlin_Improved : public Noise {
     /// Permutation table for indices to the gradients (3D)
     std::vector<uint8_t> perms3;
 
+    /// Float tables for fill_grid
+    NoiseTable2D table;
+
 public:
     Perlin_Improved(uint64_t seed): engine(seed), grads(4), grads3(16), distr(-1.0, 1.0), perms(256), perms3(256) {
         /// 4 gradients for each edge of a unit square, no need for padding, is power of 2
@@ -566,6 +837,19 @@ public:
 
         /// Randomize the order of the indices
         std::shuffle(perms.begin(), perms.end(), engine);
+        table.set(perms, grads);
+    }
+
+    /// get_value in float precision
+    float sample(float x, float y) const { return lattice_sample<true>(table, x, y); }
+
+#if defined(__AVX2__)
+    /// sample of eight samples
+    __m256 sample8(__m256 x, __m256 y) const { return lattice_sample8<true>(table, x, y); }
+#endif
+
+    void fill_grid(const Vec2f& origin, const Vec2f& step, size_t width, size_t height, float* out) const override {
+        fill_grid_lanes(*this, origin, step, width, height, out);
     }
 
     double get_value(double X, double Y) const {
@@ -578,10 +862,10 @@ public:
         int Y1 = (int) std::ceil(Y);
 
         /// Gradients using hashed indices from lookup list
-        Vec2<double> x0y0 = grads[perms[(X0 + perms[Y0 % perms.size()]) % perms.size()]];
-        Vec2<double> x1y0 = grads[perms[(X1 + perms[Y0 % perms.size()]) % perms.size()]];
-        Vec2<double> x0y1 = grads[perms[(X0 + perms[Y1 % perms.size()]) % perms.size()]];
-        Vec2<double> x1y1 = grads[perms[(X1 + perms[Y1 % perms.size()]) % perms.size()]];
+        Vec2<double> x0y0 = grads[perms[(X0 + perms[Y0 & hash_mask]) & hash_mask]];
+        Vec2<double> x1y0 = grads[perms[(X1 + perms[Y0 & hash_mask]) & hash_mask]];
+        Vec2<double> x0y1 = grads[perms[(X0 + perms[Y1 & hash_mask]) & hash_mask]];
+        Vec2<double> x1y1 = grads[perms[(X1 + perms[Y1 & hash_mask]) & hash_mask]];
 
         /// Vectors from gradients to point in unit square
         auto v00 = Vec2<double>{X - X0, Y - Y0};
@@ -622,15 +906,15 @@ public:
         int Z1 = (int) std::ceil(Z);
 
         /// Gradients using hashed indices from lookup list
-        Vec3<double> x0y0z0 = grads3[perms[(X0 + perms[(Y0 + perms[Z0 % perms.size()]) % perms.size()]) % perms.size()]];
-        Vec3<double> x1y0z0 = grads3[perms[(X1 + perms[(Y0 + perms[Z0 % perms.size()]) % perms.size()]) % perms.size()]];
-        Vec3<double> x0y1z0 = grads3[perms[(X0 + perms[(Y1 + perms[Z0 % perms.size()]) % perms.size()]) % perms.size()]];
-        Vec3<double> x1y1z0 = grads3[perms[(X1 + perms[(Y1 + perms[Z0 % perms.size()]) % perms.size()]) % perms.size()]];
+        Vec3<double> x0y0z0 = grads3[perms[(X0 + perms[(Y0 + perms[Z0 & hash_mask]) & hash_mask]) & hash_mask]];
+        Vec3<double> x1y0z0 = grads3[perms[(X1 + perms[(Y0 + perms[Z0 & hash_mask]) & hash_mask]) & hash_mask]];
+        Vec3<double> x0y1z0 = grads3[perms[(X0 + perms[(Y1 + perms[Z0 & hash_mask]) & hash_mask]) & hash_mask]];
+        Vec3<double> x1y1z0 = grads3[perms[(X1 + perms[(Y1 + perms[Z0 & hash_mask]) & hash_mask]) & hash_mask]];
 
-        Vec3<double> x0y0z1 = grads3[perms[(X0 + perms[(Y0 + perms[Z1 % perms.size()]) % perms.size()]) % perms.size()]];
-        Vec3<double> x1y0z1 = grads3[perms[(X1 + perms[(Y0 + perms[Z1 % perms.size()]) % perms.size()]) % perms.size()]];
-        Vec3<double> x0y1z1 = grads3[perms[(X0 + perms[(Y1 + perms[Z1 % perms.size()]) % perms.size()]) % perms.size()]];
-        Vec3<double> x1y1z1 = grads3[perms[(X1 + perms[(Y1 + perms[Z1 % perms.size()]) % perms.size()]) % perms.size()]];
+        Vec3<double> x0y0z1 = grads3[perms[(X0 + perms[(Y0 + perms[Z1 & hash_mask]) & hash_mask]) & hash_mask]];
+        Vec3<double> x1y0z1 = grads3[perms[(X1 + perms[(Y0 + perms[Z1 & hash_mask]) & hash_mask]) & hash_mask]];
+        Vec3<double> x0y1z1 = grads3[perms[(X0 + perms[(Y1 + perms[Z1 & hash_mask]) & hash_mask]) & hash_mask]];
+        Vec3<double> x1y1z1 = grads3[perms[(X1 + perms[(Y1 + perms[Z1 & hash_mask]) & hash_mask]) & hash_mask]];
 
         /// Vectors from gradients to point in unit cube
         auto v000 = Vec3<double>{X - X0, Y - Y0, Z - Z0};
@@ -699,6 +983,9 @@ class Perlin : public Noise {
     /// Permutation table for indices to the gradients
     std::vector<uint8_t> perms;
 
+    /// Float tables for fill_grid
+    NoiseTable2D table;
+
 public:
     Perlin(uint64_t seed): engine(seed), grads(256), grads3(256), distr(-1.0, 1.0), perms(256) {
         /// Fill the gradients list with random normalized vectors
@@ -718,6 +1005,19 @@ public:
 
         /// Randomize the order of the indices
         std::shuffle(perms.begin(), perms.end(), engine);
+        table.set(perms, grads);
+    }
+
+    /// get_value in float precision
+    float sample(float x, float y) const { return lattice_sample<false>(table, x, y); }
+
+#if defined(__AVX2__)
+    /// sample of eight samples
+    __m256 sample8(__m256 x, __m256 y) const { return lattice_sample8<false>(table, x, y); }
+#endif
+
+    void fill_grid(const Vec2f& origin, const Vec2f& step, size_t width, size_t height, float* out) const override {
+        fill_grid_lanes(*this, origin, step, width, height, out);
     }
 
     double get_value(double X, double Y) const {
@@ -730,11 +1030,10 @@ public:
         int Y1 = (int) std::ceil(Y);
 
         /// Gradients using hashed indices from lookup list
-        // FIXME: Implement variation where perms.size() is a power of two in order to do a bit masking instead, measure speedup.
-        Vec2<double> x0y0 = grads[perms[(X0 + perms[Y0 % perms.size()]) % perms.size()]];
-        Vec2<double> x1y0 = grads[perms[(X1 + perms[Y0 % perms.size()]) % perms.size()]];
-        Vec2<double> x0y1 = grads[perms[(X0 + perms[Y1 % perms.size()]) % perms.size()]];
-        Vec2<double> x1y1 = grads[perms[(X1 + perms[Y1 % perms.size()]) % perms.size()]];
+        Vec2<double> x0y0 = grads[perms[(X0 + perms[Y0 & hash_mask]) & hash_mask]];
+        Vec2<double> x1y0 = grads[perms[(X1 + perms[Y0 & hash_mask]) & hash_mask]];
+        Vec2<double> x0y1 = grads[perms[(X0 + perms[Y1 & hash_mask]) & hash_mask]];
+        Vec2<double> x1y1 = grads[perms[(X1 + perms[Y1 & hash_mask]) & hash_mask]];
 
         /// Vectors from gradients to point in unit square
         auto v00 = Vec2<double>{X - X0, Y - Y0};
@@ -775,15 +1074,15 @@ public:
         int Z1 = (int) std::ceil(Z);
 
         /// Gradients using hashed indices from lookup list
-        Vec3<double> x0y0z0 = grads3[perms[(X0 + perms[(Y0 + perms[Z0 % perms.size()]) % perms.size()]) % perms.size()]];
-        Vec3<double> x1y0z0 = grads3[perms[(X1 + perms[(Y0 + perms[Z0 % perms.size()]) % perms.size()]) % perms.size()]];
-        Vec3<double> x0y1z0 = grads3[perms[(X0 + perms[(Y1 + perms[Z0 % perms.size()]) % perms.size()]) % perms.size()]];
-        Vec3<double> x1y1z0 = grads3[perms[(X1 + perms[(Y1 + perms[Z0 % perms.size()]) % perms.size()]) % perms.size()]];
+        Vec3<double> x0y0z0 = grads3[perms[(X0 + perms[(Y0 + perms[Z0 & hash_mask]) & hash_mask]) & hash_mask]];
+        Vec3<double> x1y0z0 = grads3[perms[(X1 + perms[(Y0 + perms[Z0 & hash_mask]) & hash_mask]) & hash_mask]];
+        Vec3<double> x0y1z0 = grads3[perms[(X0 + perms[(Y1 + perms[Z0 & hash_mask]) & hash_mask]) & hash_mask]];
+        Vec3<double> x1y1z0 = grads3[perms[(X1 + perms[(Y1 + perms[Z0 & hash_mask]) & hash_mask]) & hash_mask]];
 
-        Vec3<double> x0y0z1 = grads3[perms[(X0 + perms[(Y0 + perms[Z1 % perms.size()]) % perms.size()]) % perms.size()]];
-        Vec3<double> x1y0z1 = grads3[perms[(X1 + perms[(Y0 + perms[Z1 % perms.size()]) % perms.size()]) % perms.size()]];
-        Vec3<double> x0y1z1 = grads3[perms[(X0 + perms[(Y1 + perms[Z1 % perms.size()]) % perms.size()]) % perms.size()]];
-        Vec3<double> x1y1z1 = grads3[perms[(X1 + perms[(Y1 + perms[Z1 % perms.size()]) % perms.size()]) % perms.size()]];
+        Vec3<double> x0y0z1 = grads3[perms[(X0 + perms[(Y0 + perms[Z1 & hash_mask]) & hash_mask]) & hash_mask]];
+        Vec3<double> x1y0z1 = grads3[perms[(X1 + perms[(Y0 + perms[Z1 & hash_mask]) & hash_mask]) & hash_mask]];
+        Vec3<double> x0y1z1 = grads3[perms[(X0 + perms[(Y1 + perms[Z1 & hash_mask]) & hash_mask]) & hash_mask]];
+        Vec3<double> x1y1z1 = grads3[perms[(X1 + perms[(Y1 + perms[Z1 & hash_mask]) & hash_mask]) & hash_mask]];
 
         /// Vectors from gradients to point in unit cube
         auto v000 = Vec3<double>{X - X0, Y - Y0, Z - Z0};
@@ -834,4 +1133,185 @@ public:
     }
 };
 
-#endif // NOISE_H
\ No newline at end of file
+/************ Compile-time noise pipelines ************/
+/// The generator, the octave count and the persistence are template parameters, so a pipeline is a set of static
+/// functions without virtual calls whose octave loop the compiler unrolls, and the tables of a seed are constants
+
+/// Index list for building the static tables with pack expansions, built by halving to keep the recursion shallow
+template<size_t... Is>
+struct NoiseIndices {};
+
+template<typename A, typename B>
+struct ConcatNoiseIndices;
+
+template<size_t... A, size_t... B>
+struct ConcatNoiseIndices<NoiseIndices<A...>, NoiseIndices<B...>> {
+    typedef NoiseIndices<A..., (sizeof...(A) + B)...> type;
+};
+
+template<size_t N>
+struct MakeNoiseIndices {
+    typedef typename ConcatNoiseIndices<typename MakeNoiseIndices<N / 2>::type,
+                                        typename MakeNoiseIndices<N - N / 2>::type>::type type;
+};
+
+template<>
+struct MakeNoiseIndices<0> { typedef NoiseIndices<> type; };
+
+template<>
+struct MakeNoiseIndices<1> { typedef NoiseIndices<0> type; };
+
+/// Integer hash (MurmurHash3 finalizer) for deriving the keys of the permutation from the seed
+constexpr uint32_t static_noise_xorshift(uint32_t x, uint32_t shift) { return x ^ (x >> shift); }
+constexpr uint32_t static_noise_hash(uint32_t x) {
+    return static_noise_xorshift(static_noise_xorshift(static_noise_xorshift(x, 16) * 0x85EBCA6Bu, 13) * 0xC2B2AE35u, 16);
+}
+
+/// One round of a bijection on [0, 256); multiplication by an odd number, addition and a xorshift
+constexpr uint32_t static_noise_round(uint32_t x, uint32_t key, uint32_t shift) {
+    return static_noise_xorshift((x * (key | 1u) + (key >> 8)) & 255u, shift);
+}
+
+/// Permutation of [0, 256) given by the seed, four rounds with keys hashed from the seed
+constexpr uint32_t static_noise_permutation(uint32_t seed, uint32_t i) {
+    return static_noise_round(static_noise_round(static_noise_round(static_noise_round(i & 255u,
+        static_noise_hash(seed), 3), static_noise_hash(seed + 1), 4), static_noise_hash(seed + 2), 5), static_noise_hash(seed + 3), 3);
+}
+
+/// cos(k * 22.5 degrees) for k in [0, 4]
+constexpr float static_noise_quarter_cosine(uint32_t k) {
+    return k == 0 ? 1.0f : k == 1 ? 0.923879533f : k == 2 ? 0.707106781f : k == 3 ? 0.382683432f : 0.0f;
+}
+
+/// cos(k * 22.5 degrees) for k in [0, 16)
+constexpr float static_noise_cosine(uint32_t k) {
+    return k <= 4 ? static_noise_quarter_cosine(k) : k <= 8 ? -static_noise_quarter_cosine(8 - k) :
+           k <= 12 ? -static_noise_quarter_cosine(k - 8) : static_noise_quarter_cosine(16 - k);
+}
+
+/// Gradients are one of 16 unit vectors evenly spread around the circle, picked by a second permutation
+constexpr uint32_t static_noise_direction(uint32_t seed, uint32_t i) { return static_noise_permutation(seed ^ 0xA5A5A5A5u, i) & 15u; }
+
+/**
+ * NoiseTable2D of a seed computed at compile time
+ * - Permutations from an integer bijection instead of a shuffle, repeated once like in NoiseTable2D
+ * - Gradients from a fixed set of 16 directions instead of random vectors
+ */
+template<uint32_t Seed, typename Indices = typename MakeNoiseIndices<512>::type>
+struct StaticNoiseTable2D;
+
+template<uint32_t Seed, size_t... Is>
+struct StaticNoiseTable2D<Seed, NoiseIndices<Is...>> {
+    static constexpr int32_t perms[sizeof...(Is)] = { int32_t(static_noise_permutation(Seed, Is))... };
+    static constexpr float grad_x[sizeof...(Is)] = { static_noise_cosine(static_noise_direction(Seed, Is)) ... };
+    static constexpr float grad_y[sizeof...(Is)] = { static_noise_cosine((static_noise_direction(Seed, Is) + 12u) & 15u) ... };
+};
+
+template<uint32_t Seed, size_t... Is>
+constexpr int32_t StaticNoiseTable2D<Seed, NoiseIndices<Is...>>::perms[sizeof...(Is)];
+template<uint32_t Seed, size_t... Is>
+constexpr float StaticNoiseTable2D<Seed, NoiseIndices<Is...>>::grad_x[sizeof...(Is)];
+template<uint32_t Seed, size_t... Is>
+constexpr float StaticNoiseTable2D<Seed, NoiseIndices<Is...>>::grad_y[sizeof...(Is)];
+
+/// Perlin (Fade = false) or Perlin_Improved (Fade = true) 2D noise with compile-time tables
+template<uint32_t Seed, bool Fade>
+struct StaticLatticeNoise {
+    static float sample(float x, float y) { return NoiseLanes::lattice_sample<Fade>(StaticNoiseTable2D<Seed>(), x, y); }
+
+#if defined(__AVX2__)
+    static __m256 sample8(__m256 x, __m256 y) { return NoiseLanes::lattice_sample8<Fade>(StaticNoiseTable2D<Seed>(), x, y); }
+#endif
+};
+
+template<uint32_t Seed>
+using StaticPerlin = StaticLatticeNoise<Seed, false>;
+
+template<uint32_t Seed>
+using StaticPerlinImproved = StaticLatticeNoise<Seed, true>;
+
+/// Fbm sums the octaves, Turbulence sums their absolute values
+enum class FractalSum { Fbm, Turbulence };
+
+/// 2^exponent
+constexpr float static_noise_exp2(int exponent) {
+    return exponent == 0 ? 1.0f : exponent > 0 ? 2.0f * static_noise_exp2(exponent - 1) : 0.5f * static_noise_exp2(exponent + 1);
+}
+
+/// Ratio^exponent
+template<typename Ratio>
+constexpr float static_noise_power(int exponent) {
+    return exponent == 0 ? 1.0f : float(Ratio::num) / float(Ratio::den) * static_noise_power<Ratio>(exponent - 1);
+}
+
+/// Octave of a StaticFractal, adds itself to the total and passes it on to the next octave
+/// Octave 0 is the coarsest, each octave doubles the frequency up to the last octave which samples at the coordinates
+template<typename Generator, int Octaves, typename Persistence, FractalSum Sum, int Octave, bool Last = (Octave + 1 == Octaves)>
+struct StaticOctave {
+    static constexpr float frequency() { return static_noise_exp2(Octave + 1 - Octaves); }
+    static constexpr float amplitude() { return static_noise_power<Persistence>(Octave); }
+
+    static float fold(float value) { return Sum == FractalSum::Turbulence ? std::abs(value) : value; }
+
+    static float sum(float x, float y, float total) {
+        total += fold(Generator::sample(x * frequency(), y * frequency())) * amplitude();
+        return StaticOctave<Generator, Octaves, Persistence, Sum, Octave + 1>::sum(x, y, total);
+    }
+
+#if defined(__AVX2__)
+    static __m256 fold(__m256 value) {
+        return Sum == FractalSum::Turbulence ? _mm256_andnot_ps(_mm256_set1_ps(-0.0f), value) : value;
+    }
+
+    static __m256 sum(__m256 x, __m256 y, __m256 total) {
+        const __m256 f = _mm256_set1_ps(frequency());
+        const __m256 value = fold(Generator::sample8(_mm256_mul_ps(x, f), _mm256_mul_ps(y, f)));
+        total = _mm256_add_ps(total, _mm256_mul_ps(value, _mm256_set1_ps(amplitude())));
+        return StaticOctave<Generator, Octaves, Persistence, Sum, Octave + 1>::sum(x, y, total);
+    }
+#endif
+};
+
+template<typename Generator, int Octaves, typename Persistence, FractalSum Sum, int Octave>
+struct StaticOctave<Generator, Octaves, Persistence, Sum, Octave, true> {
+    static float sum(float x, float y, float total) {
+        return total + StaticOctave<Generator, Octaves, Persistence, Sum, Octave, false>::fold(Generator::sample(x, y)) *
+                       StaticOctave<Generator, Octaves, Persistence, Sum, Octave, false>::amplitude();
+    }
+
+#if defined(__AVX2__)
+    static __m256 sum(__m256 x, __m256 y, __m256 total) {
+        typedef StaticOctave<Generator, Octaves, Persistence, Sum, Octave, false> Octave_;
+        const __m256 value = Octave_::fold(Generator::sample8(x, y));
+        return _mm256_add_ps(total, _mm256_mul_ps(value, _mm256_set1_ps(Octave_::amplitude())));
+    }
+#endif
+};
+
+/**
+ * Fractal sum of Octaves octaves of the Generator (StaticPerlin, StaticPerlinImproved) with the amplitude of each
+ * octave Persistence (a std::ratio) times that of the next coarser one, evaluated in float precision
+ * - StaticFractal<G, N> is Noise::fbm(v, 2^(N - 1)) and StaticFractal<G, N, std::ratio<1, 2>, FractalSum::Turbulence>
+ *   is Noise::turbulence(x, y, 2^(N - 1)) of the same generator
+ */
+template<typename Generator, int Octaves, typename Persistence = std::ratio<1, 2>, FractalSum Sum = FractalSum::Fbm>
+struct StaticFractal {
+    static_assert(Octaves >= 1, "A fractal sum needs at least one octave");
+
+    static float sample(float x, float y) {
+        return StaticOctave<Generator, Octaves, Persistence, Sum, 0>::sum(x, y, 0.0f);
+    }
+
+#if defined(__AVX2__)
+    static __m256 sample8(__m256 x, __m256 y) {
+        return StaticOctave<Generator, Octaves, Persistence, Sum, 0>::sum(x, y, _mm256_setzero_ps());
+    }
+#endif
+
+    /// Same layout as Noise::fill_grid
+    static void fill_grid(const Vec2f& origin, const Vec2f& step, size_t width, size_t height, float* out) {
+        NoiseLanes::fill_grid_lanes(StaticFractal(), origin, step, width, height, out);
+    }
+};
+
+#endif // NOISE_H
@@ -2,6 +2,9 @@
 #ifndef MEINEKRAFT_QUATERNION_H
 #define MEINEKRAFT_QUATERNION_H
 
+#include <algorithm>
+#include <cmath>
+
 #include "vector.h"
 
 struct quat;
@@ -21,6 +24,14 @@ struct quat {
     return std::sqrt(v.dot(v) + w * w);
   }
 
+  float dot(const quat& q) const {
+    return v.dot(q.v) + w * q.w;
+  }
+
+  quat normalize() const {
+    return (1 / this->norm()) * *this;
+  }
+
   quat inverse() const {
     return (1 / this->norm()) * this->conjugate();
   }
@@ -30,15 +41,43 @@ struct quat {
   }
 
   /// Utils
-  /// Rotates point around the quat vector v by deg degrees
+  /// Unit quaternion rotating rads radians around the axis
+  static quat axis_angle(const Vec3<float>& axis, const float rads) {
+    return quat(std::sin(rads / 2.0f) * axis.normalize(), std::cos(rads / 2.0f));
+  }
+
+  /// Rotates point around the quat vector v by rads radians
   Vec3<float> rotate(const Vec3<float>& point, const float rads) const {
-    quat p(point, 1.0);
-    quat q(std::sin(rads / 2.0f) * v.normalize(), std::cos(rads / 2.0f));
-    return quat(q * (p * q.inverse())).v;
+    return axis_angle(v, rads).rotate(point);
+  }
+
+  /// Rotates the point by this unit quaternion, q * p * q^-1 expanded with the conjugate as the inverse
+  Vec3<float> rotate(const Vec3<float>& point) const {
+    const Vec3<float> t = 2.0f * v.cross(point);
+    return point + w * t + v.cross(t);
+  }
+
+  /// Normalised linear interpolation from a to b along the shorter arc, t in [0, 1]
+  static quat nlerp(const quat& a, const quat& b, const float t) {
+    const float sign = a.dot(b) < 0.0f ? -1.0f : 1.0f;
+    return quat(a.v + t * (sign * b.v - a.v), a.w + t * (sign * b.w - a.w)).normalize();
+  }
+
+  /// Spherical linear interpolation from a to b along the shorter arc, at a constant angular velocity
+  static quat slerp(const quat& a, const quat& b, const float t) {
+    const float cos_angle = a.dot(b);
+    const float sign = cos_angle < 0.0f ? -1.0f : 1.0f;
+    const float d = std::min(std::abs(cos_angle), 1.0f);
+    if (d > 0.9995f) { return nlerp(a, b, t); } // sin(angle) vanishes, the arc is a line
+    const float angle = std::acos(d);
+    const float inv_sin = 1.0f / std::sin(angle);
+    const float wa = std::sin((1.0f - t) * angle) * inv_sin;
+    const float wb = sign * std::sin(t * angle) * inv_sin;
+    return quat(wa * a.v + wb * b.v, wa * a.w + wb * b.w);
   }
 
   /// Operators
-  inline quat operator*(const quat& r) {
+  inline quat operator*(const quat& r) const {
     return quat{v.cross(r.v) + r.w * v + w * r.v, w * r.w - v.dot(r.v)};
   }
 
@@ -2,9 +2,16 @@
 #ifndef MEINEKRAFT_VECTOR_H
 #define MEINEKRAFT_VECTOR_H
 
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <type_traits>
 #include <vector>
 
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
 /************ Forward declarations ************/
 template<typename T>
 struct Vec2;
@@ -15,6 +22,10 @@ struct Vec3;
 template<typename T>
 struct Vec4;
 
+/// Type of lengths and other fractional results of a vector of T, double for double and float otherwise
+template<typename T>
+using Real = typename std::conditional<std::is_same<T, double>::value, double, float>::type;
+
 template<typename T>
 struct Vec4 {
     T x, y, z, w;
@@ -79,6 +90,9 @@ struct Vec3 {
     constexpr explicit Vec3(const Vec4<T>& v): x(v.x), y(v.y), z(v.z) {};
     constexpr explicit Vec3(T val): x(val), y(val), z(val) {};
     constexpr Vec3(): x{}, y{}, z{} {};
+    /// Component-wise conversion, e.g. from voxel coordinates to positions
+    template<typename U>
+    constexpr explicit Vec3(const Vec3<U>& v): x(T(v.x)), y(T(v.y)), z(T(v.z)) {};
 
     inline static Vec3 zero() { return Vec3(0.0, 0.0, 0.0); }
 
@@ -91,12 +105,17 @@ struct Vec3 {
     /// Unit vector along z-axis
     inline static Vec3 Z() { return Vec3(0.0, 0.0, 1.0); }
 
-    /// Length of the vector
-    inline float length() const { return std::sqrt(std::pow(x, 2) + std::pow(y, 2) + std::pow(z, 2)); }
+    /// Length of the vector, the squares are summed in double precision (as std::pow(x, 2) did)
+    inline Real<T> length() const {
+        return Real<T>(std::sqrt(double(x) * double(x) + double(y) * double(y) + double(z) * double(z)));
+    }
+
+    /// Length squared, without the square root or any conversion
+    inline T squared_length() const { return x * x + y * y + z * z; }
 
     /// Normalizes a copy of this vector and returns it
     inline Vec3<T> normalize() const {
-        const float length = this->length();
+        const Real<T> length = this->length();
         Vec3<T> result;
         result.x = x / length;
         result.y = y / length;
@@ -140,7 +159,7 @@ struct Vec3 {
         return Vec3<T>{x + rhs.x, y + rhs.y, z + rhs.z};
     }
 
-    inline Vec3<T> operator+(const double rhs) const {
+    inline Vec3<T> operator+(const T rhs) const {
         return Vec3<T>{x + rhs, y + rhs, z + rhs};
     }
 
@@ -207,7 +226,7 @@ struct Vec2 {
 
     /// Returns a copy of this vector normalized
     inline Vec2<T> normalize() const {
-        double length = this->length();
+        const Real<T> length = this->length();
         Vec2<T> result;
         result.x = x / length;
         result.y = y / length;
@@ -215,7 +234,10 @@ struct Vec2 {
     }
 
     /// Length of the vector
-    inline double length() const { return std::sqrt(std::pow(x, 2) + std::pow(y, 2)); }
+    inline Real<T> length() const { return Real<T>(std::sqrt(double(x) * double(x) + double(y) * double(y))); }
+
+    /// Length squared, without the square root or any conversion
+    inline T squared_length() const { return x * x + y * y; }
 
     friend std::ostream &operator<<(std::ostream& os, const Vec2& v) {
       return os << "(x: " << v.x << ", y: " << v.y << std::endl;
@@ -254,23 +276,25 @@ public:
     }
 
     /// Translation - moves the matrix projection in space ...
+    /// Same as multiplying with the translation matrix, only the terms that are not multiplied by zero are computed
     inline Mat4<T> translate(const Vec3<T>& vec) const {
         Mat4<T> matrix;
-        matrix[0] = { 1.0f, 0.0f, 0.0f, 0.0f };
-        matrix[1] = { 0.0f, 1.0f, 0.0f, 0.0f };
-        matrix[2] = { 0.0f, 0.0f, 1.0f, 0.0f };
-        matrix[3] = { vec.x, vec.y, vec.z, 1.0f };
-        return *this * matrix;
+        for (uint8_t i = 0; i < 4; ++i) {
+            const Vec4<T>& row = rows[i];
+            matrix.rows[i] = Vec4<T>(row.x + row.w * vec.x, row.y + row.w * vec.y, row.z + row.w * vec.z, row.w);
+        }
+        return matrix;
     }
 
     /// Scales the matrix the same over all axis except w
+    /// Same as multiplying with the scaling matrix, only the terms that are not multiplied by zero are computed
     inline Mat4<T> scale(const T scale) const {
         Mat4<T> matrix;
-        matrix[0] = {scale, 0.0f, 0.0f, 0.0f};
-        matrix[1] = {0.0f, scale, 0.0f, 0.0f};
-        matrix[2] = {0.0f, 0.0f, scale, 0.0f};
-        matrix[3] = {0.0f, 0.0f,  0.0f, 1.0f};
-        return *this * matrix;
+        for (uint8_t i = 0; i < 4; ++i) {
+            const Vec4<T>& row = rows[i];
+            matrix.rows[i] = Vec4<T>(row.x * scale, row.y * scale, row.z * scale, row.w);
+        }
+        return matrix;
     }
 
     /// Transposes the current matrix and returns that matrix
@@ -300,14 +324,16 @@ public:
 
     /************ Operators ************/
     /// Standard matrix multiplication row-column wise; *this * mat
+    /// Each row of the result is the sum of the rows of mat scaled by the row of this, summed in column order
+    /// Mat4<float> is specialised with SSE/AVX below, the sums are done in the same order thus the results are equal
     inline Mat4<T> operator*(const Mat4<T>& mat) const {
         Mat4<T> matrix;
         for (uint8_t i = 0; i < 4; ++i) {
-            const auto row = rows[i];
-            for (uint8_t j = 0; j < 4; ++j) {
-                const Vec4<T> column = Vec4<T>{mat[0][j], mat[1][j], mat[2][j], mat[3][j]};
-                matrix.rows[i][j] = row[0]*column[0] + row[1]*column[1] + row[2]*column[2] + row[3]*column[3];
-            }
+            const Vec4<T>& row = rows[i];
+            matrix.rows[i].x = row.x * mat.rows[0].x + row.y * mat.rows[1].x + row.z * mat.rows[2].x + row.w * mat.rows[3].x;
+            matrix.rows[i].y = row.x * mat.rows[0].y + row.y * mat.rows[1].y + row.z * mat.rows[2].y + row.w * mat.rows[3].y;
+            matrix.rows[i].z = row.x * mat.rows[0].z + row.y * mat.rows[1].z + row.z * mat.rows[2].z + row.w * mat.rows[3].z;
+            matrix.rows[i].w = row.x * mat.rows[0].w + row.y * mat.rows[1].w + row.z * mat.rows[2].w + row.w * mat.rows[3].w;
         }
         return matrix;
     }
@@ -315,9 +341,10 @@ public:
     /// A * v = b
     inline Vec4<T> operator*(Vec4<T> rhs) const {
         Vec4<T> result;
-        for (int i = 0; i < 4; i++) {
-            result[i] = rows[i].x * rhs.x + rows[i].y * rhs.y + rows[i].z * rhs.z + rows[i].w * rhs.w;
-        }
+        result.x = rows[0].x * rhs.x + rows[0].y * rhs.y + rows[0].z * rhs.z + rows[0].w * rhs.w;
+        result.y = rows[1].x * rhs.x + rows[1].y * rhs.y + rows[1].z * rhs.z + rows[1].w * rhs.w;
+        result.z = rows[2].x * rhs.x + rows[2].y * rhs.y + rows[2].z * rhs.z + rows[2].w * rhs.w;
+        result.w = rows[3].x * rhs.x + rows[3].y * rhs.y + rows[3].z * rhs.z + rows[3].w * rhs.w;
         return result;
     }
 
@@ -330,6 +357,104 @@ public:
     }
 };
 
+/************ SIMD specialisations ************/
+/// Selected at compile time by the instruction sets enabled (-mavx2, /arch:AVX2), the generic versions above are the
+/// scalar fallback. The products are summed in the same order as the scalar versions, which makes the results equal
+/// as long as the compiler does not contract them into fused multiply-adds.
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+static_assert(sizeof(Mat4<float>) == 16 * sizeof(float), "Mat4<float> rows must be packed for the SIMD versions");
+
+template<>
+inline Mat4<float> Mat4<float>::operator*(const Mat4<float>& mat) const {
+    Mat4<float> matrix;
+#if defined(__AVX__)
+    /// Two rows of the result at a time, each lane broadcasts the element of its row
+    const __m256 m0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&mat.rows[0].x));
+    const __m256 m1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&mat.rows[1].x));
+    const __m256 m2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&mat.rows[2].x));
+    const __m256 m3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&mat.rows[3].x));
+    for (uint8_t i = 0; i < 4; i += 2) {
+        const __m256 a = _mm256_loadu_ps(&rows[i].x);
+        __m256 r = _mm256_mul_ps(_mm256_permute_ps(a, 0x00), m0);
+        r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_permute_ps(a, 0x55), m1));
+        r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_permute_ps(a, 0xAA), m2));
+        r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_permute_ps(a, 0xFF), m3));
+        _mm256_storeu_ps(&matrix.rows[i].x, r);
+    }
+#else
+    const __m128 m0 = _mm_loadu_ps(&mat.rows[0].x);
+    const __m128 m1 = _mm_loadu_ps(&mat.rows[1].x);
+    const __m128 m2 = _mm_loadu_ps(&mat.rows[2].x);
+    const __m128 m3 = _mm_loadu_ps(&mat.rows[3].x);
+    for (uint8_t i = 0; i < 4; ++i) {
+        const __m128 a = _mm_loadu_ps(&rows[i].x);
+        __m128 r = _mm_mul_ps(_mm_shuffle_ps(a, a, 0x00), m0);
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, 0x55), m1));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, 0xAA), m2));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, 0xFF), m3));
+        _mm_storeu_ps(&matrix.rows[i].x, r);
+    }
+#endif
+    return matrix;
+}
+
+template<>
+inline Vec4<float> Mat4<float>::operator*(Vec4<float> rhs) const {
+    /// Columns scaled by the components of the vector, the columns are the transposed rows
+    __m128 c0 = _mm_loadu_ps(&rows[0].x);
+    __m128 c1 = _mm_loadu_ps(&rows[1].x);
+    __m128 c2 = _mm_loadu_ps(&rows[2].x);
+    __m128 c3 = _mm_loadu_ps(&rows[3].x);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    __m128 r = _mm_mul_ps(c0, _mm_set1_ps(rhs.x));
+    r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(rhs.y)));
+    r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(rhs.z)));
+    r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(rhs.w)));
+    Vec4<float> result;
+    _mm_storeu_ps(&result.x, r);
+    return result;
+}
+
+template<>
+inline Mat4<float> Mat4<float>::translate(const Vec3<float>& vec) const {
+    /// Each row gains w * vec, w itself is kept as is
+    const __m128 offset = _mm_setr_ps(vec.x, vec.y, vec.z, 0.0f);
+    const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    Mat4<float> matrix;
+    for (uint8_t i = 0; i < 4; ++i) {
+        const __m128 a = _mm_loadu_ps(&rows[i].x);
+        const __m128 r = _mm_add_ps(a, _mm_mul_ps(_mm_shuffle_ps(a, a, 0xFF), offset));
+        _mm_storeu_ps(&matrix.rows[i].x, _mm_or_ps(_mm_and_ps(xyz, r), _mm_andnot_ps(xyz, a)));
+    }
+    return matrix;
+}
+
+template<>
+inline Mat4<float> Mat4<float>::scale(const float scale) const {
+    const __m128 factors = _mm_setr_ps(scale, scale, scale, 1.0f);
+    Mat4<float> matrix;
+    for (uint8_t i = 0; i < 4; ++i) {
+        _mm_storeu_ps(&matrix.rows[i].x, _mm_mul_ps(_mm_loadu_ps(&rows[i].x), factors));
+    }
+    return matrix;
+}
+
+template<>
+inline Mat4<float> Mat4<float>::transpose() {
+    __m128 r0 = _mm_loadu_ps(&rows[0].x);
+    __m128 r1 = _mm_loadu_ps(&rows[1].x);
+    __m128 r2 = _mm_loadu_ps(&rows[2].x);
+    __m128 r3 = _mm_loadu_ps(&rows[3].x);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    Mat4<float> mat;
+    _mm_storeu_ps(&mat.rows[0].x, r0);
+    _mm_storeu_ps(&mat.rows[1].x, r1);
+    _mm_storeu_ps(&mat.rows[2].x, r2);
+    _mm_storeu_ps(&mat.rows[3].x, r3);
+    return mat;
+}
+#endif
+
 /// Convenience type declarations
 using Vec2i = Vec2<int32_t>;
 using Vec3i = Vec3<int32_t>;
@@ -349,4 +474,72 @@ using Vec3d = Vec3<double>;
 using Vec4d = Vec4<double>;
 using Mat4d = Mat4<double>;
 
+/************ Voxel coordinates ************/
+/// Integer division rounding towards negative infinity, so that negative voxels belong to the chunk below them
+/// instead of to chunk 0 as with operator/, divisor > 0
+inline int32_t floor_div(const int32_t value, const int32_t divisor) {
+    return value / divisor - (value % divisor < 0 ? 1 : 0);
+}
+
+/// Remainder of floor_div, in [0, divisor)
+inline int32_t floor_mod(const int32_t value, const int32_t divisor) {
+    const int32_t remainder = value % divisor;
+    return remainder < 0 ? remainder + divisor : remainder;
+}
+
+inline Vec3i floor_div(const Vec3i& value, const int32_t divisor) {
+    return Vec3i(floor_div(value.x, divisor), floor_div(value.y, divisor), floor_div(value.z, divisor));
+}
+
+inline Vec3i floor_mod(const Vec3i& value, const int32_t divisor) {
+    return Vec3i(floor_mod(value.x, divisor), floor_mod(value.y, divisor), floor_mod(value.z, divisor));
+}
+
+/// Voxel containing the position, voxel v spans [v, v + 1) along each axis
+inline Vec3i voxel_coordinate(const Vec3f& position) {
+    return Vec3i(int32_t(std::floor(position.x)), int32_t(std::floor(position.y)), int32_t(std::floor(position.z)));
+}
+
+/// Chunk containing a voxel and the position of the voxel within the chunk
+struct ChunkCoordinate {
+    Vec3i chunk; // Chunk c spans the voxels [c * chunk_size, (c + 1) * chunk_size)
+    Vec3i local; // In [0, chunk_size) along each axis
+};
+
+inline ChunkCoordinate split_chunk(const Vec3i& voxel, const int32_t chunk_size) {
+    return ChunkCoordinate{floor_div(voxel, chunk_size), floor_mod(voxel, chunk_size)};
+}
+
+/// Spreads the low 21 bits of the value out to every third bit
+inline uint64_t morton_spread(const uint32_t value) {
+    uint64_t bits = value & 0x1FFFFF;
+    bits = (bits | bits << 32) & 0x001F00000000FFFFull;
+    bits = (bits | bits << 16) & 0x001F0000FF0000FFull;
+    bits = (bits | bits << 8)  & 0x100F00F00F00F00Full;
+    bits = (bits | bits << 4)  & 0x10C30C30C30C30C3ull;
+    bits = (bits | bits << 2)  & 0x1249249249249249ull;
+    return bits;
+}
+
+/// Gathers every third bit back into the low 21 bits, inverse of morton_spread
+inline uint32_t morton_compact(uint64_t bits) {
+    bits &= 0x1249249249249249ull;
+    bits = (bits ^ bits >> 2)  & 0x10C30C30C30C30C3ull;
+    bits = (bits ^ bits >> 4)  & 0x100F00F00F00F00Full;
+    bits = (bits ^ bits >> 8)  & 0x001F0000FF0000FFull;
+    bits = (bits ^ bits >> 16) & 0x001F00000000FFFFull;
+    bits = (bits ^ bits >> 32) & 0x1FFFFF;
+    return uint32_t(bits);
+}
+
+/// Morton (Z-order) code of the low 21 bits of each coordinate with x in the lowest bit, voxels close to each other
+/// get codes close to each other. Meant for chunk local coordinates, negative ones wrap around
+inline uint64_t morton_encode(const Vec3i& voxel) {
+    return morton_spread(uint32_t(voxel.x)) | morton_spread(uint32_t(voxel.y)) << 1 | morton_spread(uint32_t(voxel.z)) << 2;
+}
+
+inline Vec3i morton_decode(const uint64_t code) {
+    return Vec3i(int32_t(morton_compact(code)), int32_t(morton_compact(code >> 1)), int32_t(morton_compact(code >> 2)));
+}
+
 #endif // MEINEKRAFT_VECTOR_H
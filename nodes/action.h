@@ -0,0 +1,84 @@
+#pragma once
+#ifndef MEINEKRAFT_ACTION_H
+#define MEINEKRAFT_ACTION_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "archetype.h"
+#include "../util/inlinefunction.h"
+
+/// Action run each frame with the frame number and delta time, stored inline so running it does not allocate
+using Action = InlineFunction<void(uint64_t, uint64_t), 64>;
+
+struct ActionComponent {
+  Action action;
+  ActionComponent(const Action& action): action(action) {}
+};
+
+/// Behaviour run each frame on every chunk of entities matching its query, with the frame number and delta time
+using BehaviourFunction = std::function<void(const ChunkView&, uint64_t, uint64_t)>;
+
+struct Behaviour {
+  std::string name;
+  Query query;
+  BehaviourFunction func;
+};
+
+/// Runs the per-entity actions and the behaviours of each frame
+/// Actions are closures run one entity at a time, the slow path for one-offs. Behaviours are the bulk path, they
+/// get the component columns of a whole chunk at once and process them in a single loop, chunks in parallel.
+struct ActionSystem {
+  ActionSystem() {}
+  ~ActionSystem() {}
+  /// Singleton instance
+  static ActionSystem& instance() {
+    static ActionSystem instance;
+    return instance;
+  }
+
+  /// The components live in the archetype tables
+  void add_component(const ActionComponent& component, const ID id) {
+    ArchetypeStorage::instance().add(id, component);
+  }
+
+  void remove_component(const ID id) {
+    ArchetypeStorage::instance().remove<ActionComponent>(id);
+  }
+
+  /// Adds a behaviour run on all entities with the components Ts (and those of filter), e.g
+  ///   add_behaviour<Velocity>("Move", [](uint64_t frame, uint64_t dt, size_t count, const ID* ids, Velocity* velocities) {..});
+  /// The columns hold count components each, one per entity in ids. Not thread safe, add while no systems run.
+  template<typename... Ts, typename F>
+  void add_behaviour(const std::string& name, F func, Query filter = Query()) {
+    const bool includes[] = {true, (filter.with<Ts>(), true)...};
+    (void)includes;
+    behaviours.push_back(Behaviour{name, filter, [func](const ChunkView& view, uint64_t frame, uint64_t dt) {
+      func(frame, dt, view.count, view.ids, view.template column<Ts>()...);
+    }});
+  }
+
+  const std::vector<Behaviour>& get_behaviours() const {
+    return behaviours;
+  }
+
+  /// Actions and behaviours run in parallel, a chunk at a time, and must only modify their own entities
+  void execute_actions(const uint64_t frame, const uint64_t dt) {
+    auto& storage = ArchetypeStorage::instance();
+    storage.parallel_each<ActionComponent>([&](const ID, ActionComponent& component) {
+      component.action(frame, dt);
+    });
+    for (const auto& behaviour : behaviours) {
+      storage.parallel_for_each_chunk(behaviour.query, [&](const ChunkView& view) {
+        behaviour.func(view, frame, dt);
+      });
+    }
+  }
+
+private:
+  std::vector<Behaviour> behaviours;
+};
+
+#endif // MEINEKRAFT_ACTION_H
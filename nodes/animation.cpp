@@ -0,0 +1,297 @@
+#include "animation.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "../util/jobsystem.h"
+#include "../util/logging.h"
+
+const AnimationHandle AnimationSystem::none;
+
+void AnimationChannel::add_position(const float time, const Vec3f& position) {
+  position_times.push_back(time);
+  position_x.push_back(position.x);
+  position_y.push_back(position.y);
+  position_z.push_back(position.z);
+}
+
+void AnimationChannel::add_rotation(const float time, const quat& rotation) {
+  rotation_times.push_back(time);
+  rotation_x.push_back(rotation.v.x);
+  rotation_y.push_back(rotation.v.y);
+  rotation_z.push_back(rotation.v.z);
+  rotation_w.push_back(rotation.w);
+}
+
+void AnimationChannel::add_scale(const float time, const Vec3f& scale) {
+  scale_times.push_back(time);
+  scale_x.push_back(scale.x);
+  scale_y.push_back(scale.y);
+  scale_z.push_back(scale.z);
+}
+
+/// Number of tracks whose keyframes are gathered and interpolated together
+static const size_t batch_size = 64;
+
+/// Keyframes a and b of up to four components and the interpolation factor between them for each track of a batch
+struct KeyLanes {
+  alignas(32) float t[batch_size];
+  alignas(32) float a[4][batch_size];
+  alignas(32) float b[4][batch_size];
+  alignas(32) float out[4][batch_size];
+};
+
+typedef std::vector<float> AnimationChannel::* KeyArray;
+
+/// Last keyframe at or before the time, 0 before the first one
+/// Tracks move less than a keyframe per frame, so a few steps from the previous keyframe usually find it and a binary
+/// search is only needed after jumps such as looping around
+static size_t find_key(const std::vector<float>& key_times, const float time, size_t key) {
+  const size_t last = key_times.size() - 1;
+  key = std::min(key, last);
+  for (size_t steps = 0; steps < 4; steps++) {
+    if (key_times[key] > time) {
+      if (key == 0) { return 0; }
+      key--;
+    } else if (key < last && key_times[key + 1] <= time) {
+      key++;
+    } else {
+      return key;
+    }
+  }
+  const size_t next = size_t(std::upper_bound(key_times.begin(), key_times.end(), time) - key_times.begin());
+  return next == 0 ? 0 : next - 1;
+}
+
+/// Gathers the keyframes around the time of each track, clamped to the first and last keyframe
+template<typename Cursor>
+static void gather(const AnimationChannel* const* channels, const float* times, Cursor* cursors,
+                   uint32_t Cursor::* cursor, const size_t count, const KeyArray key_times, const KeyArray* components,
+                   const size_t num_components, KeyLanes& lanes) {
+  for (size_t i = 0; i < count; i++) {
+    const std::vector<float>& key_time = channels[i]->*key_times;
+    const size_t a = find_key(key_time, times[i], cursors[i].*cursor);
+    const size_t b = a + 1 == key_time.size() || times[i] < key_time[0] ? a : a + 1;
+    cursors[i].*cursor = uint32_t(a);
+    lanes.t[i] = a == b ? 0.0f : (times[i] - key_time[a]) / (key_time[b] - key_time[a]);
+    for (size_t c = 0; c < num_components; c++) {
+      const std::vector<float>& keys = channels[i]->*components[c];
+      lanes.a[c][i] = keys[a];
+      lanes.b[c][i] = keys[b];
+    }
+  }
+}
+
+/// out = a + (b - a) * t for the first num_components components
+static void lerp_lanes(const size_t count, const size_t num_components, KeyLanes& lanes) {
+  for (size_t c = 0; c < num_components; c++) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+      const __m256 a = _mm256_load_ps(&lanes.a[c][i]);
+      const __m256 b = _mm256_load_ps(&lanes.b[c][i]);
+      const __m256 t = _mm256_load_ps(&lanes.t[i]);
+      _mm256_store_ps(&lanes.out[c][i], _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t)));
+    }
+#endif
+    for (; i < count; i++) {
+      lanes.out[c][i] = lanes.a[c][i] + (lanes.b[c][i] - lanes.a[c][i]) * lanes.t[i];
+    }
+  }
+}
+
+/// Factor of nlerp following slerp, a fit of the error of nlerp in the cosine of the angle d (Zeux, "Approximating
+/// slerp"). Within 0.001 radians of slerp, without the acos and sin of it.
+static inline float slerp_factor(const float d, const float t) {
+  const float A = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+  const float B = 0.848013f + d * (-1.06021f + d * 0.215638f);
+  const float u = t - 0.5f;
+  const float k = A * u * u + B;
+  return t + t * u * (t - 1.0f) * k;
+}
+
+/// Normalised linear interpolation of the quaternions along the shorter arc, out = normalize(a + (+-b - a) * t)
+/// With slerp the factor t is corrected to approximate the constant angular velocity of slerp
+static void nlerp_lanes(const size_t count, const bool slerp, KeyLanes& lanes) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256 sign_bit = _mm256_set1_ps(-0.0f);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  for (; i + 8 <= count; i += 8) {
+    __m256 a[4], b[4];
+    for (size_t c = 0; c < 4; c++) {
+      a[c] = _mm256_load_ps(&lanes.a[c][i]);
+      b[c] = _mm256_load_ps(&lanes.b[c][i]);
+    }
+    const __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[0], b[0]), _mm256_mul_ps(a[1], b[1])),
+                                                   _mm256_mul_ps(a[2], b[2])), _mm256_mul_ps(a[3], b[3]));
+    const __m256 flip = _mm256_and_ps(dot, sign_bit); // b and -b are the same rotation, -b if it is closer to a
+    __m256 t = _mm256_load_ps(&lanes.t[i]);
+    if (slerp) {
+      const __m256 d = _mm256_andnot_ps(sign_bit, dot);
+      const __m256 A = _mm256_add_ps(_mm256_set1_ps(1.0904f), _mm256_mul_ps(d, _mm256_add_ps(_mm256_set1_ps(-3.2452f),
+                         _mm256_mul_ps(d, _mm256_sub_ps(_mm256_set1_ps(3.55645f), _mm256_mul_ps(d, _mm256_set1_ps(1.43519f)))))));
+      const __m256 B = _mm256_add_ps(_mm256_set1_ps(0.848013f), _mm256_mul_ps(d, _mm256_add_ps(_mm256_set1_ps(-1.06021f),
+                         _mm256_mul_ps(d, _mm256_set1_ps(0.215638f)))));
+      const __m256 u = _mm256_sub_ps(t, half);
+      const __m256 k = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(A, u), u), B);
+      t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, u), _mm256_sub_ps(t, one)), k));
+    }
+    __m256 r[4];
+    for (size_t c = 0; c < 4; c++) {
+      r[c] = _mm256_add_ps(a[c], _mm256_mul_ps(_mm256_sub_ps(_mm256_xor_ps(b[c], flip), a[c]), t));
+    }
+    const __m256 length2 = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r[0], r[0]), _mm256_mul_ps(r[1], r[1])),
+                                                       _mm256_mul_ps(r[2], r[2])), _mm256_mul_ps(r[3], r[3]));
+    const __m256 inv_length = _mm256_div_ps(one, _mm256_sqrt_ps(length2));
+    for (size_t c = 0; c < 4; c++) {
+      _mm256_store_ps(&lanes.out[c][i], _mm256_mul_ps(r[c], inv_length));
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    const float dot = lanes.a[0][i] * lanes.b[0][i] + lanes.a[1][i] * lanes.b[1][i] + lanes.a[2][i] * lanes.b[2][i] +
+                      lanes.a[3][i] * lanes.b[3][i];
+    const float t = slerp ? slerp_factor(std::abs(dot), lanes.t[i]) : lanes.t[i];
+    float r[4];
+    for (size_t c = 0; c < 4; c++) {
+      const float b = std::signbit(dot) ? -lanes.b[c][i] : lanes.b[c][i];
+      r[c] = lanes.a[c][i] + (b - lanes.a[c][i]) * t;
+    }
+    const float inv_length = 1.0f / std::sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + r[3] * r[3]);
+    for (size_t c = 0; c < 4; c++) {
+      lanes.out[c][i] = r[c] * inv_length;
+    }
+  }
+}
+
+AnimationHandle AnimationSystem::add_clip(const AnimationClip& clip) {
+  std::unique_ptr<AnimationClip> added(new AnimationClip(clip));
+  float end = 0.0f;
+  const TransformComponent rest;
+  for (auto& channel : added->channels) {
+    if (channel.position_times.empty()) { channel.add_position(0.0f, rest.position); }
+    if (channel.rotation_times.empty()) { channel.add_rotation(0.0f, rest.rotation); }
+    if (channel.scale_times.empty()) { channel.add_scale(0.0f, rest.scale); }
+    end = std::max({end, channel.position_times.back(), channel.rotation_times.back(), channel.scale_times.back()});
+  }
+  if (added->duration <= 0.0f) { added->duration = end; }
+  std::lock_guard<std::mutex> lk(clips_mutex);
+  clips.push_back(std::move(added));
+  return AnimationHandle(clips.size() - 1);
+}
+
+AnimationHandle AnimationSystem::find_clip(const std::string& name) const {
+  std::lock_guard<std::mutex> lk(clips_mutex);
+  for (size_t i = 1; i < clips.size(); i++) {
+    if (clips[i]->name == name) { return AnimationHandle(i); }
+  }
+  return none;
+}
+
+int32_t AnimationSystem::find_channel(const AnimationHandle clip, const std::string& node) const {
+  std::lock_guard<std::mutex> lk(clips_mutex);
+  if (clip == none || clip >= clips.size()) { return -1; }
+  const auto& channels = clips[clip]->channels;
+  for (size_t i = 0; i < channels.size(); i++) {
+    if (channels[i].node == node) { return int32_t(i); }
+  }
+  return -1;
+}
+
+void AnimationSystem::play(const ID entity, const AnimationHandle clip, const uint32_t channel, const float time,
+                           const float speed, const bool loop) {
+  std::lock_guard<std::mutex> lk(clips_mutex);
+  if (clip == none || clip >= clips.size() || channel >= clips[clip]->channels.size()) {
+    Log::warn("Tried to play non-existent channel " + std::to_string(channel) + " of animation " + std::to_string(clip));
+    return;
+  }
+  const size_t slot = tracks.insert(entity);
+  if (slot == track_channels.size()) {
+    track_channels.emplace_back();
+    track_times.emplace_back();
+    track_speeds.emplace_back();
+    track_durations.emplace_back();
+    track_loops.emplace_back();
+    track_keys.emplace_back();
+  }
+  track_channels[slot] = &clips[clip]->channels[channel];
+  track_times[slot] = time;
+  track_speeds[slot] = speed;
+  track_durations[slot] = clips[clip]->duration;
+  track_loops[slot] = loop;
+  track_keys[slot] = KeyCursors{0, 0, 0};
+}
+
+void AnimationSystem::stop(const ID entity) {
+  const size_t slot = tracks.remove(entity);
+  if (slot == SparseIndex::npos) { return; }
+  swap_remove(track_channels, slot);
+  swap_remove(track_times, slot);
+  swap_remove(track_speeds, slot);
+  swap_remove(track_durations, slot);
+  swap_remove(track_loops, slot);
+  swap_remove(track_keys, slot);
+}
+
+void AnimationSystem::update(const float dt) {
+  /// No lock, clips are never removed or moved and the tracks point at their channels since play, so clips may be
+  /// added meanwhile (e.g by a load run while this waits on the JobSystem)
+  samples.resize(tracks.size());
+  const ID* ids = tracks.ids().data();
+  JobSystem::instance().parallel_for(0, tracks.size(), 256, [&](const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const float duration = track_durations[i];
+      float time = track_times[i] + dt * track_speeds[i];
+      if (track_loops[i] && duration > 0.0f) {
+        time = std::fmod(time, duration);
+        if (time < 0.0f) { time += duration; }
+      } else {
+        time = std::max(0.0f, std::min(time, duration));
+      }
+      track_times[i] = time;
+    }
+    sample(begin, end);
+    TransformSystem::instance().set_components(ids + begin, samples.data() + begin, end - begin);
+  });
+}
+
+void AnimationSystem::sample(const size_t begin, const size_t end) {
+  static const KeyArray positions[] = {&AnimationChannel::position_x, &AnimationChannel::position_y,
+                                       &AnimationChannel::position_z};
+  static const KeyArray rotations[] = {&AnimationChannel::rotation_x, &AnimationChannel::rotation_y,
+                                       &AnimationChannel::rotation_z, &AnimationChannel::rotation_w};
+  static const KeyArray scales[] = {&AnimationChannel::scale_x, &AnimationChannel::scale_y, &AnimationChannel::scale_z};
+  const bool slerp = rotation_interpolation == RotationInterpolation::Slerp;
+  KeyLanes lanes;
+  for (size_t first = begin; first < end; first += batch_size) {
+    const size_t count = std::min(batch_size, end - first);
+    const AnimationChannel* const* channels = track_channels.data() + first;
+    const float* times = track_times.data() + first;
+    KeyCursors* cursors = track_keys.data() + first;
+    TransformComponent* out = samples.data() + first;
+
+    gather(channels, times, cursors, &KeyCursors::position, count, &AnimationChannel::position_times, positions, 3, lanes);
+    lerp_lanes(count, 3, lanes);
+    for (size_t i = 0; i < count; i++) {
+      out[i].position = Vec3f(lanes.out[0][i], lanes.out[1][i], lanes.out[2][i]);
+    }
+
+    gather(channels, times, cursors, &KeyCursors::rotation, count, &AnimationChannel::rotation_times, rotations, 4, lanes);
+    nlerp_lanes(count, slerp, lanes);
+    for (size_t i = 0; i < count; i++) {
+      out[i].rotation = quat(Vec3f(lanes.out[0][i], lanes.out[1][i], lanes.out[2][i]), lanes.out[3][i]);
+    }
+
+    gather(channels, times, cursors, &KeyCursors::scale, count, &AnimationChannel::scale_times, scales, 3, lanes);
+    lerp_lanes(count, 3, lanes);
+    for (size_t i = 0; i < count; i++) {
+      out[i].scale = Vec3f(lanes.out[0][i], lanes.out[1][i], lanes.out[2][i]);
+    }
+  }
+}
@@ -0,0 +1,106 @@
+#pragma once
+#ifndef MEINEKRAFT_ANIMATION_H
+#define MEINEKRAFT_ANIMATION_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "transform.h"
+#include "../util/sparseset.h"
+
+typedef uint32_t AnimationHandle;
+
+/// Keyframes of one node, the position, rotation and scale keys each have their own times in seconds (ascending)
+/// Stored as structure of arrays so that sampling gathers single floats from contiguous arrays
+struct AnimationChannel {
+  std::string node; // Name of the animated node
+  std::vector<float> position_times, position_x, position_y, position_z;
+  std::vector<float> rotation_times, rotation_x, rotation_y, rotation_z, rotation_w; // Unit quaternions
+  std::vector<float> scale_times, scale_x, scale_y, scale_z;
+
+  void add_position(const float time, const Vec3f& position);
+  void add_rotation(const float time, const quat& rotation);
+  void add_scale(const float time, const Vec3f& scale);
+};
+
+/// Channels animating the nodes of a model together
+struct AnimationClip {
+  std::string name;
+  float duration = 0.0f; // Seconds
+  std::vector<AnimationChannel> channels;
+};
+
+/// Rotation keys are blended with nlerp, or with nlerp corrected to follow slerp closely (within 0.001 radians)
+enum class RotationInterpolation {
+  Nlerp, Slerp
+};
+
+/// Plays keyframe animations on entities and writes the sampled transforms into the TransformSystem
+/// An entity plays one channel of a clip at a time (a track). Tracks are packed as structure of arrays, update
+/// samples them in parallel in batches, interpolating eight tracks at a time, and sets the sampled transforms in bulk
+/// which journals them like any other transform change.
+/// Clips may be added from any thread. Playing and stopping tracks are structural changes, do them while no systems
+/// are running.
+struct AnimationSystem {
+  static const AnimationHandle none = 0;
+
+  /// Singleton instance
+  static AnimationSystem& instance() {
+    static AnimationSystem instance;
+    return instance;
+  }
+
+  /// Registers the clip, empty key lists get a single key of the default TransformComponent, thread safe
+  AnimationHandle add_clip(const AnimationClip& clip);
+
+  /// Handle of the first clip with the name, none if there is none, thread safe
+  AnimationHandle find_clip(const std::string& name) const;
+
+  /// Channel of the clip animating the node, -1 if the clip does not animate it, thread safe
+  int32_t find_channel(const AnimationHandle clip, const std::string& node) const;
+
+  /// Plays the channel of the clip on the entity from the time (seconds) on, replacing what it played before
+  /// A negative speed plays backwards, clips that do not loop stop at their end (or start)
+  void play(const ID entity, const AnimationHandle clip, const uint32_t channel, const float time = 0.0f,
+            const float speed = 1.0f, const bool loop = true);
+
+  /// Stops the track of the entity, leaving its transform as last sampled
+  void stop(const ID entity);
+
+  /// Advances the tracks by dt seconds and sets the sampled transforms of the entities
+  /// Run before TransformSystem::compose_dirty
+  void update(const float dt);
+
+  void set_rotation_interpolation(const RotationInterpolation interpolation) { rotation_interpolation = interpolation; }
+
+  /// Number of tracks playing
+  size_t size() const { return tracks.size(); }
+
+private:
+  mutable std::mutex clips_mutex;                   // Guards clips, not the clips themselves which are immutable
+  std::vector<std::unique_ptr<AnimationClip>> clips; // Indexed by AnimationHandle, clips[none] is empty
+  RotationInterpolation rotation_interpolation = RotationInterpolation::Slerp;
+
+  /// Keyframes each track sampled last, the search for the next ones starts there
+  struct KeyCursors {
+    uint32_t position, rotation, scale;
+  };
+
+  /// Tracks, indexed the same as the slots of tracks
+  SparseIndex tracks;
+  std::vector<const AnimationChannel*> track_channels;
+  std::vector<float> track_times, track_speeds, track_durations;
+  std::vector<uint8_t> track_loops;
+  std::vector<KeyCursors> track_keys;
+  std::vector<TransformComponent> samples;          // Scratch space of update
+
+  AnimationSystem(): clips(1) {}
+
+  /// Samples the tracks [begin, end) into samples
+  void sample(const size_t begin, const size_t end);
+};
+
+#endif // MEINEKRAFT_ANIMATION_H
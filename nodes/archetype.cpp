@@ -0,0 +1,222 @@
+#include "archetype.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+#include "../util/logging.h"
+
+const size_t ArchetypeChunk::bytes;
+const size_t ArchetypeChunk::alignment;
+
+ArchetypeStorage::ArchetypeStorage() {
+  components(); // Constructed first so that it outlives the storage, the destructor needs the component infos
+  find_or_create_archetype(0);
+}
+
+ArchetypeStorage::~ArchetypeStorage() {
+  for (auto& archetype : archetypes) {
+    for (auto& chunk : archetype.chunks) {
+      for (size_t column = 0; column < archetype.component_ids.size(); column++) {
+        const ComponentInfo& info = component_info(archetype.component_ids[column]);
+        for (size_t idx = 0; idx < chunk.count; idx++) {
+          info.destroy(chunk.data + archetype.offsets[column] + info.size * idx);
+        }
+      }
+    }
+  }
+}
+
+std::vector<ComponentInfo>& ArchetypeStorage::components() {
+  static std::vector<ComponentInfo> components;
+  return components;
+}
+
+uint32_t ArchetypeStorage::register_component(const size_t size, const size_t align,
+                                              void (*move_construct)(void*, void*), void (*destroy)(void*)) {
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lk(mutex);
+  auto& infos = components();
+  if (infos.size() == 64) {
+    Log::error("More than 64 component types registered in the ArchetypeStorage");
+    std::abort();
+  }
+  if (align > ArchetypeChunk::alignment) {
+    Log::error("Component alignment of " + std::to_string(align) + " exceeds the chunk alignment");
+    std::abort();
+  }
+  infos.push_back(ComponentInfo{size, align, move_construct, destroy});
+  return uint32_t(infos.size() - 1);
+}
+
+uint32_t ArchetypeStorage::find_or_create_archetype(const uint64_t mask) {
+  const auto found = archetype_idxs.find(mask);
+  if (found != archetype_idxs.cend()) { return found->second; }
+
+  Archetype archetype;
+  archetype.mask = mask;
+  std::fill(std::begin(archetype.columns), std::end(archetype.columns), -1);
+  size_t row_bytes = sizeof(ID);
+  for (uint32_t component_id = 0; component_id < 64; component_id++) {
+    if (!(mask & (uint64_t(1) << component_id))) { continue; }
+    const ComponentInfo& info = component_info(component_id);
+    if (info.size == 0) { continue; }
+    archetype.columns[component_id] = int32_t(archetype.component_ids.size());
+    archetype.component_ids.push_back(component_id);
+    row_bytes += info.size;
+  }
+
+  /// Largest capacity for which all the columns, each aligned, fit into a chunk
+  for (archetype.capacity = ArchetypeChunk::bytes / row_bytes; archetype.capacity > 0; archetype.capacity--) {
+    size_t offset = sizeof(ID) * archetype.capacity;
+    archetype.offsets.clear();
+    for (const uint32_t component_id : archetype.component_ids) {
+      const ComponentInfo& info = component_info(component_id);
+      offset = (offset + info.align - 1) & ~(info.align - 1);
+      archetype.offsets.push_back(offset);
+      offset += info.size * archetype.capacity;
+    }
+    if (offset <= ArchetypeChunk::bytes) { break; }
+  }
+  if (archetype.capacity == 0) {
+    Log::error("Components of archetype " + std::to_string(mask) + " do not fit into a chunk");
+    std::abort();
+  }
+
+  archetypes.push_back(std::move(archetype));
+  const uint32_t idx = uint32_t(archetypes.size() - 1);
+  archetype_idxs[mask] = idx;
+  return idx;
+}
+
+uint32_t ArchetypeStorage::push_row(Archetype& archetype, const ID id) {
+  const size_t row = archetype.size;
+  if (row / archetype.capacity == archetype.chunks.size()) {
+    archetype.chunks.emplace_back();
+  }
+  ArchetypeChunk& chunk = archetype.chunks[row / archetype.capacity];
+  archetype.ids(chunk)[chunk.count] = id;
+  chunk.count++;
+  archetype.size++;
+  return uint32_t(row);
+}
+
+void ArchetypeStorage::erase_row(Archetype& archetype, const uint32_t row) {
+  ArchetypeChunk& chunk = archetype.chunks[row / archetype.capacity];
+  const size_t idx = row % archetype.capacity;
+  const size_t last_row = archetype.size - 1;
+  ArchetypeChunk& last_chunk = archetype.chunks[last_row / archetype.capacity];
+  const size_t last_idx = last_row % archetype.capacity;
+
+  for (size_t column = 0; column < archetype.component_ids.size(); column++) {
+    const ComponentInfo& info = component_info(archetype.component_ids[column]);
+    uint8_t* dst = chunk.data + archetype.offsets[column] + info.size * idx;
+    info.destroy(dst);
+    if (row != last_row) {
+      uint8_t* src = last_chunk.data + archetype.offsets[column] + info.size * last_idx;
+      info.move_construct(dst, src);
+      info.destroy(src);
+    }
+  }
+  if (row != last_row) {
+    const ID moved = archetype.ids(last_chunk)[last_idx];
+    archetype.ids(chunk)[idx] = moved;
+    locations.find(moved)->row = row;
+  }
+
+  last_chunk.count--;
+  archetype.size--;
+  if (last_chunk.count == 0) {
+    archetype.chunks.pop_back(); // Releases the memory of the chunk
+  }
+}
+
+uint32_t ArchetypeStorage::move_row(const uint32_t from, const uint32_t row, const uint32_t to) {
+  Archetype& src = archetypes[from];
+  Archetype& dst = archetypes[to];
+  ArchetypeChunk& src_chunk = src.chunks[row / src.capacity];
+  const size_t src_idx = row % src.capacity;
+  const ID id = src.ids(src_chunk)[src_idx];
+
+  const uint32_t new_row = push_row(dst, id);
+  ArchetypeChunk& dst_chunk = dst.chunks[new_row / dst.capacity];
+  const size_t dst_idx = new_row % dst.capacity;
+  for (size_t column = 0; column < src.component_ids.size(); column++) {
+    const uint32_t component_id = src.component_ids[column];
+    const int32_t dst_column = dst.columns[component_id];
+    if (dst_column < 0) { continue; }
+    const ComponentInfo& info = component_info(component_id);
+    info.move_construct(dst_chunk.data + dst.offsets[size_t(dst_column)] + info.size * dst_idx,
+                        src_chunk.data + src.offsets[column] + info.size * src_idx);
+  }
+  erase_row(src, row); // Destroys the moved-from and the dropped components
+  return new_row;
+}
+
+void* ArchetypeStorage::prepare_add(const ID id, const uint32_t component_id) {
+  const uint64_t bit = uint64_t(1) << component_id;
+  EntityLocation* location = locations.find(id);
+  if (!location) {
+    const uint32_t archetype = find_or_create_archetype(bit);
+    const uint32_t row = push_row(archetypes[archetype], id);
+    locations.insert(id, EntityLocation{archetype, row});
+    return find_component(id, component_id);
+  }
+
+  if (archetypes[location->archetype].mask & bit) {
+    /// Overwrite, the existing component is destroyed and its memory reused
+    void* ptr = find_component(id, component_id);
+    if (ptr) { component_info(component_id).destroy(ptr); }
+    return ptr;
+  }
+
+  const uint32_t archetype = find_or_create_archetype(archetypes[location->archetype].mask | bit);
+  const uint32_t row = move_row(location->archetype, location->row, archetype);
+  location = locations.find(id);
+  location->archetype = archetype;
+  location->row = row;
+  return find_component(id, component_id);
+}
+
+void ArchetypeStorage::remove_component(const ID id, const uint32_t component_id) {
+  EntityLocation* location = locations.find(id);
+  if (!location) { return; }
+  const uint64_t mask = archetypes[location->archetype].mask;
+  const uint64_t bit = uint64_t(1) << component_id;
+  if (!(mask & bit)) { return; }
+  if ((mask & ~bit) == 0) {
+    destroy(id);
+    return;
+  }
+  const uint32_t archetype = find_or_create_archetype(mask & ~bit);
+  const uint32_t row = move_row(location->archetype, location->row, archetype);
+  location = locations.find(id);
+  location->archetype = archetype;
+  location->row = row;
+}
+
+void* ArchetypeStorage::find_component(const ID id, const uint32_t component_id) {
+  const EntityLocation* location = locations.find(id);
+  if (!location) { return nullptr; }
+  Archetype& archetype = archetypes[location->archetype];
+  const int32_t column = archetype.columns[component_id];
+  if (column < 0) { return nullptr; }
+  ArchetypeChunk& chunk = archetype.chunks[location->row / archetype.capacity];
+  const size_t idx = location->row % archetype.capacity;
+  return chunk.data + archetype.offsets[size_t(column)] + component_info(component_id).size * idx;
+}
+
+void ArchetypeStorage::destroy(const ID id) {
+  const EntityLocation* location = locations.find(id);
+  if (!location) { return; }
+  erase_row(archetypes[location->archetype], location->row);
+  locations.remove(id);
+}
+
+size_t ArchetypeStorage::count(const Query& query) const {
+  size_t count = 0;
+  for (const auto& archetype : archetypes) {
+    if (query.matches(archetype.mask)) { count += archetype.size; }
+  }
+  return count;
+}
@@ -0,0 +1,302 @@
+#pragma once
+#ifndef MEINEKRAFT_ARCHETYPE_H
+#define MEINEKRAFT_ARCHETYPE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../render/primitives.h"
+#include "../util/jobsystem.h"
+#include "../util/sparseset.h"
+
+/// Components owned by an engine system (e.g TransformSystem) rather than the archetype tables, their archetype
+/// records that the entity has one so that queries can filter on it but stores no column for them
+template<typename T>
+struct ExternalComponent: std::false_type {};
+
+/// Type erased operations of a component type stored in the archetype tables
+struct ComponentInfo {
+  size_t size;   // 0 for tags and external components, which have no column
+  size_t align;
+  void (*move_construct)(void* dst, void* src);
+  void (*destroy)(void* ptr);
+};
+
+template<typename T>
+struct ComponentOps {
+  static void move_construct(void* dst, void* src) { new (dst) T(std::move(*static_cast<T*>(src))); }
+  static void destroy(void* ptr) { static_cast<T*>(ptr)->~T(); }
+};
+
+/// Fixed-size block of memory holding the columns of up to Archetype::capacity entities
+/// The first column holds the entity IDs, followed by one column per stored component of the archetype.
+struct ArchetypeChunk {
+  static const size_t bytes = 16 * 1024;
+  static const size_t alignment = 64;
+
+  ArchetypeChunk(): memory(new uint8_t[bytes + alignment]) {
+    const uintptr_t address = reinterpret_cast<uintptr_t>(memory.get());
+    data = memory.get() + (alignment - address % alignment) % alignment;
+  }
+
+  std::unique_ptr<uint8_t[]> memory;
+  uint8_t* data;     // Start of the columns, aligned to alignment
+  size_t count = 0;  // Number of entities in the chunk, all chunks but the last of an archetype are full
+};
+
+/// Table of all the entities with the same set (mask) of component types
+/// Rows are packed, row r lives in chunks[r / capacity] at r % capacity. Removing a row moves the last row into it.
+struct Archetype {
+  uint64_t mask = 0;
+  std::vector<uint32_t> component_ids; // Stored components, those with a column
+  std::vector<size_t> offsets;         // Offset of the column of each of component_ids within a chunk
+  int32_t columns[64];                 // Component ID to index into component_ids, -1 if it has no column here
+  size_t capacity = 0;                 // Rows per chunk
+  size_t size = 0;                     // Number of rows
+  std::vector<ArchetypeChunk> chunks;
+
+  ID* ids(ArchetypeChunk& chunk) const { return reinterpret_cast<ID*>(chunk.data); }
+
+  /// Column of the component in the chunk, nullptr if the archetype stores no column for it
+  void* column(ArchetypeChunk& chunk, const uint32_t component_id) const {
+    const int32_t column = columns[component_id];
+    return column < 0 ? nullptr : chunk.data + offsets[size_t(column)];
+  }
+};
+
+/// View of a chunk handed to the functions run by the queries, columns are contiguous arrays of count elements
+struct ChunkView {
+  const ID* ids;
+  size_t count;
+  const Archetype* archetype;
+  ArchetypeChunk* chunk;
+
+  /// Column of the component type, nullptr for tags and external components
+  template<typename T>
+  T* column() const;
+};
+
+/// Selects the archetypes with all the included and none of the excluded component types
+struct Query {
+  uint64_t include = 0;
+  uint64_t exclude = 0;
+
+  template<typename T>
+  Query& with();
+
+  template<typename T>
+  Query& without();
+
+  bool matches(const uint64_t mask) const { return (mask & include) == include && (mask & exclude) == 0; }
+};
+
+/// Archetype tables holding the components of all entities in fixed-size chunks
+/// Queries iterate the matching chunks linearly and can split them across the JobSystem. Structural changes
+/// (adding or removing components, destroying entities) move rows between tables and are not thread safe, do them
+/// while no systems are running. Running queries may modify the components in place.
+struct ArchetypeStorage {
+  /// Singleton instance
+  static ArchetypeStorage& instance() {
+    static ArchetypeStorage instance;
+    return instance;
+  }
+
+  /// Bit of the component type in archetype masks, registers the type on first use, at most 64 types
+  template<typename T>
+  static uint32_t component_id() {
+    static const uint32_t id = register_component(
+      (std::is_empty<T>::value || ExternalComponent<T>::value) ? 0 : sizeof(T), alignof(T),
+      &ComponentOps<T>::move_construct, &ComponentOps<T>::destroy);
+    return id;
+  }
+
+  static const ComponentInfo& component_info(const uint32_t component_id) {
+    return components()[component_id];
+  }
+
+  /// Adds or overwrites the component of the entity, moving it to the archetype including the component type
+  template<typename T>
+  void add(const ID id, T component) {
+    const uint32_t component_id = ArchetypeStorage::component_id<T>();
+    void* ptr = prepare_add(id, component_id);
+    if (ptr) { new (ptr) T(std::move(component)); }
+  }
+
+  /// Records that the entity has a tag or external component
+  template<typename T>
+  void add(const ID id) {
+    static_assert(std::is_empty<T>::value || ExternalComponent<T>::value, "Components with data need a value");
+    prepare_add(id, component_id<T>());
+  }
+
+  template<typename T>
+  void remove(const ID id) {
+    remove_component(id, component_id<T>());
+  }
+
+  /// Component of the entity, nullptr if it has none or the component has no column
+  template<typename T>
+  T* get(const ID id) {
+    return static_cast<T*>(find_component(id, component_id<T>()));
+  }
+
+  template<typename T>
+  bool has(const ID id) const {
+    const EntityLocation* location = locations.find(id);
+    return location && (archetypes[location->archetype].mask & (uint64_t(1) << component_id<T>()));
+  }
+
+  /// Removes the entity and all of its components
+  void destroy(const ID id);
+
+  /// Runs func(ChunkView&) for every non-empty chunk matching the query, one after another
+  template<typename F>
+  void for_each_chunk(const Query& query, F func);
+
+  /// Runs func(ChunkView&) for every non-empty chunk matching the query in parallel on the JobSystem, blocking
+  template<typename F>
+  void parallel_for_each_chunk(const Query& query, F func);
+
+  /// Runs func(ID, Ts&...) for every entity with all of Ts, the types must have columns
+  template<typename... Ts, typename F>
+  void each(F func);
+
+  /// Parallel version of each, func must only modify the components it is handed
+  template<typename... Ts, typename F>
+  void parallel_each(F func);
+
+  /// Number of entities matching the query
+  size_t count(const Query& query) const;
+
+  /// Makes room for count entities in total
+  void reserve(const size_t count) { locations.reserve(count); }
+
+  /// Number of entities with at least one component
+  size_t size() const { return locations.size(); }
+
+  const std::vector<Archetype>& get_archetypes() const { return archetypes; }
+
+private:
+  struct EntityLocation {
+    uint32_t archetype;
+    uint32_t row;
+  };
+
+  std::vector<Archetype> archetypes;                 // Index 0 is the empty archetype
+  std::unordered_map<uint64_t, uint32_t> archetype_idxs; // Mask to index into archetypes, only used on structural changes
+  SparseSet<EntityLocation> locations;
+
+  ArchetypeStorage();
+  ~ArchetypeStorage();
+
+  static std::vector<ComponentInfo>& components();
+  static uint32_t register_component(const size_t size, const size_t align, void (*move_construct)(void*, void*),
+                                     void (*destroy)(void*));
+
+  uint32_t find_or_create_archetype(const uint64_t mask);
+
+  /// Moves the entity into the archetype with the component, returns the uninitialised memory of the component,
+  /// nullptr if it has no column. An existing component is destroyed and its memory returned.
+  void* prepare_add(const ID id, const uint32_t component_id);
+  void remove_component(const ID id, const uint32_t component_id);
+  void* find_component(const ID id, const uint32_t component_id);
+
+  /// Appends a row for the entity, its columns are left uninitialised
+  uint32_t push_row(Archetype& archetype, const ID id);
+
+  /// Destroys the components left in the row and moves the last row into it
+  void erase_row(Archetype& archetype, const uint32_t row);
+
+  /// Moves the entity with all the components both archetypes store, the rest are destroyed
+  uint32_t move_row(const uint32_t from, const uint32_t row, const uint32_t to);
+
+  template<typename... Ts, typename F>
+  static void each_row(F& func, const size_t count, const ID* ids, Ts*... columns) {
+    for (size_t i = 0; i < count; i++) {
+      func(ids[i], columns[i]...);
+    }
+  }
+};
+
+template<typename T>
+T* ChunkView::column() const {
+  return static_cast<T*>(archetype->column(*chunk, ArchetypeStorage::component_id<T>()));
+}
+
+template<typename T>
+Query& Query::with() {
+  include |= uint64_t(1) << ArchetypeStorage::component_id<T>();
+  return *this;
+}
+
+template<typename T>
+Query& Query::without() {
+  exclude |= uint64_t(1) << ArchetypeStorage::component_id<T>();
+  return *this;
+}
+
+template<typename F>
+void ArchetypeStorage::for_each_chunk(const Query& query, F func) {
+  for (auto& archetype : archetypes) {
+    if (archetype.size == 0 || !query.matches(archetype.mask)) { continue; }
+    for (auto& chunk : archetype.chunks) {
+      if (chunk.count == 0) { continue; }
+      ChunkView view{archetype.ids(chunk), chunk.count, &archetype, &chunk};
+      func(view);
+    }
+  }
+}
+
+template<typename F>
+void ArchetypeStorage::parallel_for_each_chunk(const Query& query, F func) {
+  /// Views of all the matching chunks in the scratch memory of the calling thread, split across the workers
+  size_t num_chunks = 0;
+  for (const auto& archetype : archetypes) {
+    if (archetype.size > 0 && query.matches(archetype.mask)) { num_chunks += archetype.chunks.size(); }
+  }
+  ScratchArena& arena = JobSystem::scratch();
+  const size_t mark = arena.mark();
+  ChunkView* views = arena.allocate<ChunkView>(num_chunks);
+  if (!views) {
+    arena.rewind(mark);
+    for_each_chunk(query, func);
+    return;
+  }
+  size_t num_views = 0;
+  for_each_chunk(query, [&](ChunkView& view) { views[num_views++] = view; });
+  JobSystem::instance().parallel_for(0, num_views, 1, [&](const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      func(views[i]);
+    }
+  });
+  arena.rewind(mark);
+}
+
+template<typename... Ts, typename F>
+void ArchetypeStorage::each(F func) {
+  Query query;
+  const bool includes[] = {true, (query.with<Ts>(), true)...};
+  (void)includes;
+  for_each_chunk(query, [&](ChunkView& view) {
+    each_row(func, view.count, view.ids, view.template column<Ts>()...);
+  });
+}
+
+template<typename... Ts, typename F>
+void ArchetypeStorage::parallel_each(F func) {
+  Query query;
+  const bool includes[] = {true, (query.with<Ts>(), true)...};
+  (void)includes;
+  parallel_for_each_chunk(query, [&](ChunkView& view) {
+    each_row(func, view.count, view.ids, view.template column<Ts>()...);
+  });
+}
+
+#endif // MEINEKRAFT_ARCHETYPE_H
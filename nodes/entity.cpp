@@ -1 +1,17 @@
+#include "entity.h"
 
+void EntitySystem::destroy_entity(const ID& id) {
+  if (!lookup(id)) { return; }
+  auto& storage = ArchetypeStorage::instance();
+  if (storage.has<RenderComponent>(id)) { Renderer::instance().remove_component(id); }
+  if (storage.has<TransformComponent>(id)) {
+    TransformSystem::instance().remove_component(id);
+    SpatialHash::instance().remove(id);
+    AnimationSystem::instance().stop(id);
+  }
+  storage.destroy(id);
+  std::lock_guard<std::mutex> lk(mutex);
+  const uint32_t index = entity_index(id);
+  generations[index]++;
+  free_indices.push_back(index);
+}
@@ -4,230 +4,78 @@
 
 #include "../render/rendercomponent.h"
 #include "transform.h"
+#include "archetype.h"
+#include "action.h"
+#include "entitysystem.h"
+#include "spatialhash.h"
+#include "animation.h"
 #include "../render/render.h"
 
-#include <algorithm>
-#include <functional>
-#include <future>
+/// Stored by the TransformSystem and the Renderer, the archetypes only record which entities have them
+template<>
+struct ExternalComponent<TransformComponent>: std::true_type {};
 
-/// Semaphore
-struct Semaphore {
-private:
-  size_t value = 0;
-  std::mutex mut;
-
-public:
-  explicit Semaphore(size_t val) : value(val) {}
-
-  void post(const size_t val = 1) {
-    std::unique_lock<std::mutex> lk(mut);
-    value += val;
-  }
-
-  size_t get_value() {
-    std::unique_lock<std::mutex> lk(mut);
-    return value;
-  }
-
-  bool peek() {
-    std::unique_lock<std::mutex> lk(mut);
-    return value != 0;
-  }
-
-  /// PEek EQuals 
-  bool peeq(const size_t i) {
-    std::unique_lock<std::mutex> lk(mut);
-    return value == i;
-  }
-
-  bool try_wait() {
-    std::unique_lock<std::mutex> lk(mut);
-    if (value == 0) {
-      return false;
-    } else {
-      value--;
-      return true;
-    }
-  }
-};
-
-struct JobSystem {
-  /// Singleton instance
-  static JobSystem& instance() {
-    static JobSystem instance;
-    return instance;
-  }
-
-  struct Worker {
-    enum class WorkerState: uint8_t { Working = 0, Ready = 1, Idle = 2, Exit = 3 };
-    Semaphore sem; // 0 working, 1 ready, 2 done/idle, 3 exit
-    std::function<void()> workload;
-    std::thread t;
-
-    Worker(): sem(2), t(&Worker::execute, this) {}
-    ~Worker() { t.join(); }
-
-    void execute() {
-      while (!sem.peeq(3)) {
-        if (sem.peeq(1)) {
-          sem.try_wait();
-          workload();
-          sem.post(2);
-        } else {
-          std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        }
-      }
-    }
-  };
-
-  std::vector<Worker> thread_pool;
-
-  JobSystem() {
-    const size_t num_threads = std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency();
-    Log::info("JobSystem using " + std::to_string(num_threads) + " workers");
-    thread_pool = std::vector<Worker>(num_threads);
-  }
-  ~JobSystem() {
-    for (size_t i = 0; i < thread_pool.size(); i++) {
-      thread_pool[i].sem.post(3);
-    }
-    std::this_thread::sleep_for(std::chrono::milliseconds(2));
-  }
-
-  // Async
-  ID execute(const std::function<void()>& func) {
-    uint64_t i = 0;
-    while (true) {
-      if (thread_pool[i].sem.peeq(2)) {
-        thread_pool[i].workload = std::move(func);
-        thread_pool[i].sem.try_wait();
-        return i;
-      }
-      i = (i + 1) % thread_pool.size();
-    }
-  }
-
-  // Blocking
-  void wait_on(const std::vector<ID>& ids) {
-    for (size_t i = 0; i < ids.size(); i++) {
-      while (thread_pool[ids[i]].sem.peeq(0)) {
-        std::this_thread::sleep_for(std::chrono::microseconds(1));
-      }
-    }
-  }
-
-  // Blocking
-  void wait_on_all() {
-    for (size_t i = 0; i < thread_pool.size(); i++) {
-      while (thread_pool[i].sem.peeq(0)) {
-        std::this_thread::sleep_for(std::chrono::microseconds(1));
-      }
-    }
-  }
-};
-  
-
-/*********************************************************************************/
-
-struct ActionComponent {
-  std::function<void(uint64_t, uint64_t)> action;
-  ActionComponent(const std::function<void(uint64_t, uint64_t)>& action): action(action) {}
-};
-
-struct ActionSystem {
-  ActionSystem() {}
-  ~ActionSystem() {}
-  /// Singleton instance
-  static ActionSystem& instance() {
-    static ActionSystem instance;
-    return instance;
-  }
-
-  std::vector<ActionComponent> components;
-
-  void add_component(const ActionComponent& component) {
-    components.emplace_back(component);
-  }
-
-  void remove_component(const ID id) {
-    // TODO: Implement
-  }
-
-  void execute_actions(const uint64_t frame, const uint64_t dt) {
-    for (const auto& component : components) {
-      component.action(frame, dt);
-    }
-  }
-};
-
-/*********************************************************************************/
-
-// Mapping: Entity ID <--> Alive?
-struct EntitySystem {
-private:
-  std::vector<ID> entities;
-  std::unordered_map<ID, ID> lut;
-
-public:
-  EntitySystem() {}
-  ~EntitySystem() {}
-  /// Singleton instance
-  static EntitySystem& instance() {
-    static EntitySystem instance;
-    return instance;
-  }
-  
-  /// Generates a new Entity id to be used when identifying this instance of Entity
-  ID new_entity() const {
-    // TODO: Implement something for real
-    static uint64_t e_id = 1; // 0 ID is usually (default value for ints..) used for invalid IDs in systems
-    return e_id++;
-  };
-
-  /// Lookup if the Entity is alive
-  bool lookup(ID entity) const {
-
-  }
-
-  // Map entity ID to the right bitflag
-  void destroy_entity(const ID& id) {
-    // TODO: Implement by removing all the components owned by the Entity (again this is mainly a convenicence thing)
-  }
-};
+template<>
+struct ExternalComponent<RenderComponent>: std::true_type {};
 
 /// Game object 
 struct Entity {
     ID id;
 
     Entity(): id(EntitySystem::instance().new_entity()) {}
-    ~Entity() {
+    /// An Entity owns its ID, a copy destroying it would destroy the original as well
+    Entity(const Entity&) = delete;
+    Entity& operator=(const Entity&) = delete;
+    virtual ~Entity() {
       EntitySystem::instance().destroy_entity(id);
     }
 
     /** Component handling for convenience **/
     inline void attach_component(const RenderComponent& component) {
       Renderer::instance().add_component(component, id);
+      ArchetypeStorage::instance().add<RenderComponent>(id);
     }
 
     inline void attach_component(const TransformComponent& component) {
       TransformSystem::instance().add_component(component, id);
+      ArchetypeStorage::instance().add<TransformComponent>(id);
     }
 
     inline void attach_component(const ActionComponent& component) {
-      ActionSystem::instance().add_component(component);
+      ActionSystem::instance().add_component(component, id);
+    }
+
+    /// Any other component type is stored in the archetype tables
+    template<typename T>
+    inline void attach_component(const T& component) {
+      ArchetypeStorage::instance().add(id, component);
+    }
+
+    template<typename T>
+    inline T* get_component() {
+      return ArchetypeStorage::instance().get<T>(id);
     }
 
     inline void deattach_component(const RenderComponent& component) {
       Renderer::instance().remove_component(id);
+      ArchetypeStorage::instance().remove<RenderComponent>(id);
     }
 
     inline void deattach_component(const TransformComponent& component) {
       TransformSystem::instance().remove_component(id);
+      SpatialHash::instance().remove(id);
+      AnimationSystem::instance().stop(id);
+      ArchetypeStorage::instance().remove<TransformComponent>(id);
     }
 
     inline void deattach_component(const ActionComponent& component) {
       ActionSystem::instance().remove_component(id);
     }
+
+    template<typename T>
+    inline void deattach_component(const T& component) {
+      ArchetypeStorage::instance().remove<T>(id);
+    }
 };
 
 #endif // MEINEKRAFT_ENTITY_H
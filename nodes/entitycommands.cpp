@@ -0,0 +1,146 @@
+#include "entitycommands.h"
+
+#include <algorithm>
+#include <iterator>
+
+const size_t EntityCommandBuffer::reserved_batch_size;
+
+ID EntityCommandBuffer::create() {
+  std::lock_guard<std::mutex> lk(mutex);
+  if (num_reserved == 0) {
+    EntitySystem::instance().reserve_entities(reserved_ids, reserved_batch_size);
+    num_reserved = reserved_batch_size;
+    std::reverse(std::begin(reserved_ids), std::end(reserved_ids)); // Hand them out in ascending order
+  }
+  return reserved_ids[--num_reserved];
+}
+
+void EntityCommandBuffer::attach(const ID id, const TransformComponent& component) {
+  std::lock_guard<std::mutex> lk(mutex);
+  recorded.transforms.emplace_back(id, component);
+}
+
+void EntityCommandBuffer::attach(const ID id, const RenderComponent& component) {
+  std::lock_guard<std::mutex> lk(mutex);
+  recorded.renders.emplace_back(id, component);
+}
+
+void EntityCommandBuffer::attach(const ID id, const ActionComponent& component) {
+  std::lock_guard<std::mutex> lk(mutex);
+  recorded.actions.emplace_back(id, component);
+}
+
+void EntityCommandBuffer::set_parent(const ID child, const ID parent) {
+  std::lock_guard<std::mutex> lk(mutex);
+  recorded.parents.emplace_back(child, parent);
+}
+
+void EntityCommandBuffer::destroy(const ID id) {
+  std::lock_guard<std::mutex> lk(mutex);
+  recorded.destroyed.push_back(id);
+}
+
+void EntityCommandBuffer::Commands::clear() {
+  transforms.clear();
+  parents.clear();
+  renders.clear();
+  actions.clear();
+  components.clear();
+  destroyed.clear();
+}
+
+template<typename T>
+static void move_append(std::vector<T>& to, std::vector<T>& from) {
+  to.insert(to.end(), std::make_move_iterator(from.begin()), std::make_move_iterator(from.end()));
+  from.clear();
+}
+
+void EntityCommandBuffer::Commands::append(Commands& other) {
+  move_append(transforms, other.transforms);
+  move_append(parents, other.parents);
+  move_append(renders, other.renders);
+  move_append(actions, other.actions);
+  move_append(components, other.components);
+  move_append(destroyed, other.destroyed);
+}
+
+/// Registers the buffer of the thread on first use, its pending commands are handed over when the thread exits
+struct LocalEntityCommandBuffer {
+  EntityCommandBuffer buffer;
+
+  LocalEntityCommandBuffer() {
+    EntityCommands::instance().add_buffer(&buffer);
+  }
+
+  ~LocalEntityCommandBuffer() {
+    EntityCommands::instance().remove_buffer(&buffer);
+  }
+};
+
+EntityCommandBuffer& EntityCommands::local() {
+  static thread_local LocalEntityCommandBuffer local;
+  return local.buffer;
+}
+
+void EntityCommands::add_buffer(EntityCommandBuffer* buffer) {
+  std::lock_guard<std::mutex> lk(mutex);
+  buffers.push_back(buffer);
+}
+
+void EntityCommands::remove_buffer(EntityCommandBuffer* buffer) {
+  std::lock_guard<std::mutex> lk(mutex);
+  buffers.erase(std::remove(buffers.begin(), buffers.end(), buffer), buffers.end());
+  std::lock_guard<std::mutex> buffer_lk(buffer->mutex);
+  orphaned.append(buffer->recorded);
+  /// IDs reserved but never handed out are destroyed with the rest so that their indices return to the free list
+  orphaned.destroyed.insert(orphaned.destroyed.end(), buffer->reserved_ids, buffer->reserved_ids + buffer->num_reserved);
+  buffer->num_reserved = 0;
+}
+
+/// Grows the store geometrically so that applying a few commands each frame does not reallocate each frame
+template<typename Store>
+static void reserve_additional(Store& store, const size_t count) {
+  if (count == 0) { return; }
+  store.reserve(std::max(store.size() + count, store.size() + store.size() / 2));
+}
+
+void EntityCommands::apply_all() {
+  {
+    std::lock_guard<std::mutex> lk(mutex);
+    applying.append(orphaned);
+    for (auto buffer : buffers) {
+      std::lock_guard<std::mutex> buffer_lk(buffer->mutex);
+      applying.append(buffer->recorded);
+    }
+  }
+
+  auto& storage = ArchetypeStorage::instance();
+  auto& transform_system = TransformSystem::instance();
+  reserve_additional(storage, applying.transforms.size());
+  reserve_additional(transform_system, applying.transforms.size());
+
+  for (const auto& transform : applying.transforms) {
+    transform_system.add_component(transform.second, transform.first);
+    storage.add<TransformComponent>(transform.first);
+  }
+  for (const auto& parent : applying.parents) {
+    transform_system.set_parent(parent.first, parent.second);
+  }
+  for (const auto& action : applying.actions) {
+    storage.add(action.first, action.second);
+  }
+  for (const auto& component : applying.components) {
+    component();
+  }
+  for (const auto& render : applying.renders) {
+    storage.add<RenderComponent>(render.first);
+  }
+  if (!applying.renders.empty()) {
+    Renderer::instance().add_components(applying.renders);
+  }
+  auto& entity_system = EntitySystem::instance();
+  for (const ID id : applying.destroyed) {
+    entity_system.destroy_entity(id);
+  }
+  applying.clear();
+}
@@ -0,0 +1,91 @@
+#pragma once
+#ifndef MEINEKRAFT_ENTITYCOMMANDS_H
+#define MEINEKRAFT_ENTITYCOMMANDS_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "entity.h"
+
+/// Records entity creation, component attachment and destruction from any thread, applied in bulk by
+/// EntityCommands::apply_all at the sync point of the frame. Each thread records into a buffer of its own, see
+/// EntityCommands::local, thus recording only contends with the application of the buffer.
+/// Created IDs are valid right away so that later commands can refer to them, the components only exist once applied.
+struct EntityCommandBuffer {
+  /// Reserves a new entity ID, IDs are taken from the EntitySystem a batch at a time
+  ID create();
+
+  void attach(const ID id, const TransformComponent& component);
+  void attach(const ID id, const RenderComponent& component);
+  void attach(const ID id, const ActionComponent& component);
+
+  /// Any other component type goes into the archetype tables
+  template<typename T>
+  void attach(const ID id, const T& component) {
+    std::lock_guard<std::mutex> lk(mutex);
+    recorded.components.push_back([=]() { ArchetypeStorage::instance().add(id, component); });
+  }
+
+  /// Applied after the transforms of the same frame have been attached
+  void set_parent(const ID child, const ID parent);
+
+  /// Applied after everything else recorded in the same frame
+  void destroy(const ID id);
+
+private:
+  friend struct EntityCommands;
+
+  /// Commands by kind, applied kind by kind so that each component store is reserved for and filled in one go
+  struct Commands {
+    std::vector<std::pair<ID, TransformComponent>> transforms;
+    std::vector<std::pair<ID, ID>> parents;
+    std::vector<std::pair<ID, RenderComponent>> renders;
+    std::vector<std::pair<ID, ActionComponent>> actions;
+    std::vector<std::function<void()>> components;
+    std::vector<ID> destroyed;
+
+    void clear();
+    void append(Commands& other);
+  };
+
+  static const size_t reserved_batch_size = 64;
+
+  std::mutex mutex;
+  Commands recorded;
+  ID reserved_ids[reserved_batch_size];
+  size_t num_reserved = 0;
+};
+
+/// Registry of the command buffers of all threads
+struct EntityCommands {
+  /// Singleton instance, never destroyed since worker threads may still exit and hand over their buffers after
+  /// the static objects are gone
+  static EntityCommands& instance() {
+    static EntityCommands* instance = new EntityCommands();
+    return *instance;
+  }
+
+  /// Command buffer of the calling thread
+  static EntityCommandBuffer& local();
+
+  /// Applies the commands recorded by all threads since the last call, in order of kind: transforms, parents,
+  /// actions, other components, render components and finally destructions
+  /// Structural change, call from the main thread while no systems are running
+  void apply_all();
+
+private:
+  friend struct LocalEntityCommandBuffer;
+
+  std::mutex mutex;                              // Guards buffers and orphaned
+  std::vector<EntityCommandBuffer*> buffers;
+  EntityCommandBuffer::Commands orphaned;        // Commands of threads that exited before they were applied
+  EntityCommandBuffer::Commands applying;        // Only touched by apply_all
+
+  void add_buffer(EntityCommandBuffer* buffer);
+  void remove_buffer(EntityCommandBuffer* buffer);
+};
+
+#endif // MEINEKRAFT_ENTITYCOMMANDS_H
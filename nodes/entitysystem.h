@@ -0,0 +1,77 @@
+#pragma once
+#ifndef MEINEKRAFT_ENTITYSYSTEM_H
+#define MEINEKRAFT_ENTITYSYSTEM_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "../render/primitives.h"
+#include "../util/sparseset.h"
+
+/// Hands out generational entity IDs, see entity_index. Indices of destroyed entities are reused from a free list,
+/// with the generation bumped so that IDs held onto past the destruction are no longer alive.
+struct EntitySystem {
+private:
+  std::vector<uint32_t> generations;  // Current generation of each entity index
+  std::vector<uint32_t> free_indices; // Indices of destroyed entities
+  mutable std::mutex mutex;           // Guards generations and free_indices, IDs may be reserved from any thread
+
+public:
+  EntitySystem() {}
+  ~EntitySystem() {}
+  /// Singleton instance
+  static EntitySystem& instance() {
+    static EntitySystem instance;
+    return instance;
+  }
+  
+  /// Generates a new Entity id to be used when identifying this instance of Entity
+  ID new_entity() {
+    ID id = 0;
+    reserve_entities(&id, 1);
+    return id;
+  };
+
+  /// Thread safe - writes count new entity IDs to ids, taking the lock once for all of them
+  void reserve_entities(ID* ids, const size_t count) {
+    std::lock_guard<std::mutex> lk(mutex);
+    if (generations.empty()) {
+      generations.push_back(0); // Index 0 is never handed out, 0 ID is usually (default value for ints..) used for invalid IDs in systems
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (free_indices.empty()) {
+        generations.push_back(0);
+        ids[i] = make_entity_id(uint32_t(generations.size() - 1), 0);
+        continue;
+      }
+      const uint32_t index = free_indices.back();
+      free_indices.pop_back();
+      ids[i] = make_entity_id(index, generations[index]);
+    }
+  }
+
+  /// Lookup if the Entity is alive
+  bool lookup(ID entity) const {
+    std::lock_guard<std::mutex> lk(mutex);
+    return is_alive(entity);
+  }
+
+  /// Number of entities alive
+  size_t size() const {
+    std::lock_guard<std::mutex> lk(mutex);
+    return generations.empty() ? 0 : generations.size() - 1 - free_indices.size();
+  }
+
+  /// Removes all the components of the entity and frees its index for reuse, IDs of it are no longer alive afterwards
+  /// Structural change, destroy entities while no systems are running
+  void destroy_entity(const ID& id);
+
+private:
+  bool is_alive(const ID entity) const {
+    const uint32_t index = entity_index(entity);
+    return index != 0 && index < generations.size() && generations[index] == entity_generation(entity);
+  }
+};
+
+#endif // MEINEKRAFT_ENTITYSYSTEM_H
@@ -1,12 +1,59 @@
 #include "model.h"
+#include "../render/meshmanager.h"
 
-Model::Model(const std::string& directory, const std::string& file) {
+Model::Model(const std::string& directory, const std::string& file):
+  parts(std::make_shared<std::vector<std::unique_ptr<Entity>>>()) {
   TransformComponent transform;
   transform.position = Vec3f(-2.0f, 2.0f, 0.0f);
-  transform.scale = 1.0f;
+  transform.scale = Vec3f(1.0f);
   attach_component(transform);
-  RenderComponent render;
-  render.set_mesh(directory, file);
-  render.set_shading_model(ShadingModel::PhysicallyBased);
-  attach_component(render);
+  /// Loads on the workers, each node of the model becomes an entity parented to the Model on the main thread
+  const ID model_id = id;
+  const std::weak_ptr<std::vector<std::unique_ptr<Entity>>> model_parts = parts;
+  run_async([=]() {
+    std::pair<MeshHierarchy, MaterialHandle> model;
+    model.first = MeshManager::load_mesh_hierarchy(directory, file);
+    Material material;
+    material.load_textures(model.first.texture_info);
+    material.set_shading_model(ShadingModel::PhysicallyBased);
+    model.second = MaterialRegistry::instance().add(material);
+    return model;
+  }).then_on_main([model_id, model_parts](std::pair<MeshHierarchy, MaterialHandle>& model) {
+    const auto entities = model_parts.lock();
+    if (!entities) { return; }
+    auto& transform_system = TransformSystem::instance();
+    auto& animation_system = AnimationSystem::instance();
+    /// Nodes animated by the first clip of the model play it on a loop
+    const AnimationHandle clip = model.first.animations.empty() ? AnimationSystem::none : model.first.animations.front();
+    std::vector<ID> node_ids;
+    for (const auto& node : model.first.nodes) {
+      entities->emplace_back(new Entity());
+      Entity* node_entity = entities->back().get();
+      node_entity->attach_component(node.transform);
+      transform_system.set_parent(node_entity->id, node.parent < 0 ? model_id : node_ids[node.parent]);
+      node_ids.push_back(node_entity->id);
+      const int32_t channel = animation_system.find_channel(clip, node.name);
+      if (channel >= 0) { animation_system.play(node_entity->id, clip, uint32_t(channel)); }
+
+      /// An entity renders one mesh, additional meshes of the node get an entity of their own
+      for (size_t i = 0; i < node.mesh_ids.size(); i++) {
+        Entity* mesh_entity = node_entity;
+        if (i > 0) {
+          entities->emplace_back(new Entity());
+          mesh_entity = entities->back().get();
+          mesh_entity->attach_component(TransformComponent());
+          transform_system.set_parent(mesh_entity->id, node_entity->id);
+        }
+        RenderComponent render;
+        render.mesh_id = node.mesh_ids[i];
+        render.material = model.second;
+        mesh_entity->attach_component(render);
+      }
+    }
+  });
+}
+
+Model::~Model() {
+  /// Children first, the Entity destructor destroys the model itself afterwards
+  parts.reset();
 }
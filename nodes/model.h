@@ -2,12 +2,21 @@
 #ifndef MEINEKRAFT_TEAPOT_H
 #define MEINEKRAFT_TEAPOT_H
 
+#include <memory>
+#include <vector>
+
 #include "entity.h"
 #include "../render/rendercomponent.h"
 
 class Model: public Entity {
 public:
     Model(const std::string& directory, const std::string& file);
+    ~Model();
+
+private:
+    /// Entities of the nodes and meshes of the model, created once it is loaded and destroyed along with the Model
+    /// Shared with the load as a weak_ptr so that a Model destroyed while loading gets no entities
+    std::shared_ptr<std::vector<std::unique_ptr<Entity>>> parts;
 };
 
 #endif //MEINEKRAFT_TEAPOT_H
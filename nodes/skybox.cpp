@@ -6,7 +6,7 @@
 
 Skybox::Skybox(): Entity() {
   TransformComponent transform;
-  transform.scale = 50.0;
+  transform.scale = Vec3f(50.0f);
   attach_component(transform);
   RenderComponent render;
   render.set_mesh(MeshPrimitive::CubeCounterClockWinding);
@@ -16,8 +16,10 @@ Skybox::Skybox(): Entity() {
                                     Filesystem::base + std::string("resources/environmentmaps/garden/negy.bmp"),
                                     Filesystem::base + std::string("resources/environmentmaps/garden/posz.bmp"),
                                     Filesystem::base + std::string("resources/environmentmaps/garden/negz.bmp")};
-  render.set_cube_map_texture(faces);
-  render.set_shading_model(ShadingModel::Unlit);
+  Material material;
+  material.set_cube_map_texture(faces);
+  material.set_shading_model(ShadingModel::Unlit);
+  render.set_material(material);
   attach_component(render);
 
   faces = {Filesystem::base + std::string("resources/lightmaps/garden/negx.bmp"),
@@ -0,0 +1,210 @@
+#include "spatialhash.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "../util/jobsystem.h"
+
+/// Appends the IDs of the cell whose positions are within the box
+static void filter_box(const std::vector<ID>& ids, const float* xs, const float* ys, const float* zs,
+                       const Vec3f& min, const Vec3f& max, std::vector<ID>& out) {
+  const size_t count = ids.size();
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256 min_x = _mm256_set1_ps(min.x), min_y = _mm256_set1_ps(min.y), min_z = _mm256_set1_ps(min.z);
+  const __m256 max_x = _mm256_set1_ps(max.x), max_y = _mm256_set1_ps(max.y), max_z = _mm256_set1_ps(max.z);
+  for (; i + 8 <= count; i += 8) {
+    const __m256 x = _mm256_loadu_ps(xs + i);
+    const __m256 y = _mm256_loadu_ps(ys + i);
+    const __m256 z = _mm256_loadu_ps(zs + i);
+    const __m256 inside_x = _mm256_and_ps(_mm256_cmp_ps(x, min_x, _CMP_GE_OQ), _mm256_cmp_ps(x, max_x, _CMP_LE_OQ));
+    const __m256 inside_y = _mm256_and_ps(_mm256_cmp_ps(y, min_y, _CMP_GE_OQ), _mm256_cmp_ps(y, max_y, _CMP_LE_OQ));
+    const __m256 inside_z = _mm256_and_ps(_mm256_cmp_ps(z, min_z, _CMP_GE_OQ), _mm256_cmp_ps(z, max_z, _CMP_LE_OQ));
+    const int mask = _mm256_movemask_ps(_mm256_and_ps(inside_x, _mm256_and_ps(inside_y, inside_z)));
+    if (mask == 0) { continue; }
+    for (int lane = 0; lane < 8; lane++) {
+      if (mask & (1 << lane)) { out.push_back(ids[i + size_t(lane)]); }
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    if (xs[i] >= min.x && xs[i] <= max.x && ys[i] >= min.y && ys[i] <= max.y && zs[i] >= min.z && zs[i] <= max.z) {
+      out.push_back(ids[i]);
+    }
+  }
+}
+
+/// Appends the IDs of the cell whose positions are within the sphere
+static void filter_sphere(const std::vector<ID>& ids, const float* xs, const float* ys, const float* zs,
+                          const Vec3f& center, const float radius_squared, std::vector<ID>& out) {
+  const size_t count = ids.size();
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256 cx = _mm256_set1_ps(center.x), cy = _mm256_set1_ps(center.y), cz = _mm256_set1_ps(center.z);
+  const __m256 r2 = _mm256_set1_ps(radius_squared);
+  for (; i + 8 <= count; i += 8) {
+    const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), cx);
+    const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(ys + i), cy);
+    const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(zs + i), cz);
+    const __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+    const int mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LE_OQ));
+    if (mask == 0) { continue; }
+    for (int lane = 0; lane < 8; lane++) {
+      if (mask & (1 << lane)) { out.push_back(ids[i + size_t(lane)]); }
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    const float dx = xs[i] - center.x, dy = ys[i] - center.y, dz = zs[i] - center.z;
+    if (dx * dx + dy * dy + dz * dz <= radius_squared) { out.push_back(ids[i]); }
+  }
+}
+
+int32_t SpatialHash::cell_coordinate(const float position) const {
+  /// Clamped so that far away (or non-finite) positions do not overflow the conversion
+  const float cell = std::floor(position / cell_size);
+  return int32_t(std::max(-1.0e9f, std::min(1.0e9f, cell)));
+}
+
+uint32_t SpatialHash::find_or_create_cell(const int32_t x, const int32_t y, const int32_t z) {
+  const uint64_t cell_key = key(x, y, z);
+  const auto found = cell_idxs.find(cell_key);
+  if (found != cell_idxs.cend()) { return found->second; }
+  uint32_t idx = 0;
+  if (free_cells.empty()) {
+    idx = uint32_t(cells.size());
+    cells.emplace_back();
+  } else {
+    idx = free_cells.back();
+    free_cells.pop_back();
+  }
+  cells[idx].key = cell_key;
+  cell_idxs[cell_key] = idx;
+  return idx;
+}
+
+void SpatialHash::insert(const ID id, const uint32_t cell_idx, const Vec3f& position) {
+  Cell& cell = cells[cell_idx];
+  locations.insert(id, Location{cell_idx, uint32_t(cell.ids.size())});
+  cell.ids.push_back(id);
+  cell.position_x.push_back(position.x);
+  cell.position_y.push_back(position.y);
+  cell.position_z.push_back(position.z);
+}
+
+void SpatialHash::erase(const Location location) {
+  Cell& cell = cells[location.cell];
+  if (location.slot + 1 != cell.ids.size()) {
+    locations.find(cell.ids.back())->slot = location.slot;
+  }
+  swap_remove(cell.ids, location.slot);
+  swap_remove(cell.position_x, location.slot);
+  swap_remove(cell.position_y, location.slot);
+  swap_remove(cell.position_z, location.slot);
+  if (cell.ids.empty()) {
+    /// The cell keeps its memory for the next one reusing it
+    cell_idxs.erase(cell.key);
+    free_cells.push_back(location.cell);
+  }
+}
+
+void SpatialHash::update(const TransformSystem& transforms) {
+  /// Cells of the moved entities are computed in parallel, the grid itself is modified on the calling thread
+  const std::vector<TransformChange>& journal = transforms.get_journal();
+  moves.resize(journal.size());
+  JobSystem::instance().parallel_for(0, journal.size(), 256, [&](const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      Move& move = moves[i];
+      move.entity_id = journal[i].entity_id;
+      move.position = transforms.at(journal[i].slot).matrix.get_translation();
+      move.x = cell_coordinate(move.position.x);
+      move.y = cell_coordinate(move.position.y);
+      move.z = cell_coordinate(move.position.z);
+    }
+  });
+
+  for (const Move& move : moves) {
+    const uint32_t cell_idx = find_or_create_cell(move.x, move.y, move.z);
+    Location* location = locations.find(move.entity_id);
+    if (location && location->cell == cell_idx) {
+      Cell& cell = cells[cell_idx];
+      cell.position_x[location->slot] = move.position.x;
+      cell.position_y[location->slot] = move.position.y;
+      cell.position_z[location->slot] = move.position.z;
+      continue;
+    }
+    if (location) { erase(*location); }
+    insert(move.entity_id, cell_idx, move.position);
+  }
+}
+
+void SpatialHash::remove(const ID id) {
+  const Location* location = locations.find(id);
+  if (!location) { return; }
+  erase(*location);
+  locations.remove(id);
+}
+
+void SpatialHash::set_cell_size(const float cell_size) {
+  moves.clear();
+  for (const auto& occupied : cell_idxs) {
+    const Cell& cell = cells[occupied.second];
+    for (size_t i = 0; i < cell.ids.size(); i++) {
+      Move move;
+      move.entity_id = cell.ids[i];
+      move.position = Vec3f(cell.position_x[i], cell.position_y[i], cell.position_z[i]);
+      moves.push_back(move);
+    }
+  }
+  cells.clear();
+  free_cells.clear();
+  cell_idxs.clear();
+  locations.clear();
+  this->cell_size = cell_size;
+  for (const Move& move : moves) {
+    const uint32_t cell_idx = find_or_create_cell(cell_coordinate(move.position.x), cell_coordinate(move.position.y),
+                                                  cell_coordinate(move.position.z));
+    insert(move.entity_id, cell_idx, move.position);
+  }
+}
+
+template<typename F>
+void SpatialHash::for_each_cell(const Vec3f& min, const Vec3f& max, F func) const {
+  const int32_t x0 = cell_coordinate(min.x), y0 = cell_coordinate(min.y), z0 = cell_coordinate(min.z);
+  const int32_t x1 = cell_coordinate(max.x), y1 = cell_coordinate(max.y), z1 = cell_coordinate(max.z);
+  if (x1 < x0 || y1 < y0 || z1 < z0) { return; }
+  /// Boxes spanning more cells than are occupied visit the occupied cells instead
+  const double num_cells = double(x1 - x0 + 1) * double(y1 - y0 + 1) * double(z1 - z0 + 1);
+  if (num_cells > double(cell_idxs.size())) {
+    for (const auto& occupied : cell_idxs) {
+      func(cells[occupied.second]);
+    }
+    return;
+  }
+  for (int32_t x = x0; x <= x1; x++) {
+    for (int32_t y = y0; y <= y1; y++) {
+      for (int32_t z = z0; z <= z1; z++) {
+        const auto found = cell_idxs.find(key(x, y, z));
+        if (found != cell_idxs.cend()) { func(cells[found->second]); }
+      }
+    }
+  }
+}
+
+void SpatialHash::query_radius(const Vec3f& center, const float radius, std::vector<ID>& out) const {
+  const Vec3f extent(radius);
+  for_each_cell(center - extent, center + extent, [&](const Cell& cell) {
+    filter_sphere(cell.ids, cell.position_x.data(), cell.position_y.data(), cell.position_z.data(), center,
+                  radius * radius, out);
+  });
+}
+
+void SpatialHash::query_aabb(const Vec3f& min, const Vec3f& max, std::vector<ID>& out) const {
+  for_each_cell(min, max, [&](const Cell& cell) {
+    filter_box(cell.ids, cell.position_x.data(), cell.position_y.data(), cell.position_z.data(), min, max, out);
+  });
+}
@@ -0,0 +1,96 @@
+#pragma once
+#ifndef MEINEKRAFT_SPATIALHASH_H
+#define MEINEKRAFT_SPATIALHASH_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "transform.h"
+#include "../util/sparseset.h"
+
+/// Uniform grid over the world positions of all transforms, answers which entities are within a radius or box
+/// Only occupied cells exist, they are found through a hash map keyed by the cell coordinates. The positions of each
+/// cell are stored as structure of arrays and filtered eight at a time.
+/// Kept up to date from the transform journal by update, queries may run concurrently with each other but not
+/// with update or remove.
+struct SpatialHash {
+  /// Singleton instance
+  static SpatialHash& instance() {
+    static SpatialHash instance;
+    return instance;
+  }
+
+  /// Moves the entities in the journal to the cells of their current world positions, inserting new ones
+  /// Run after TransformSystem::compose_dirty and before the journal is reset
+  void update(const TransformSystem& transforms);
+
+  /// Structural change, call when the transform of the entity is removed
+  void remove(const ID id);
+
+  /// Appends the entities within the radius of the center to out
+  void query_radius(const Vec3f& center, const float radius, std::vector<ID>& out) const;
+
+  /// Appends the entities within the axis aligned box [min, max] to out
+  void query_aabb(const Vec3f& min, const Vec3f& max, std::vector<ID>& out) const;
+
+  /// Rebuilds the grid with cells of the given side length, tune it to the common query radius
+  void set_cell_size(const float cell_size);
+  float get_cell_size() const { return cell_size; }
+
+  /// Number of entities in the grid
+  size_t size() const { return locations.size(); }
+
+  /// Number of occupied cells
+  size_t num_cells() const { return cell_idxs.size(); }
+
+private:
+  struct Cell {
+    uint64_t key;
+    std::vector<ID> ids;
+    std::vector<float> position_x, position_y, position_z;
+  };
+
+  struct Location {
+    uint32_t cell;
+    uint32_t slot;
+  };
+
+  /// Cell and position of a journaled entity, computed in parallel before the grid is modified
+  struct Move {
+    ID entity_id;
+    int32_t x, y, z;
+    Vec3f position;
+  };
+
+  float cell_size = 4.0f;
+  std::vector<Cell> cells;                           // Occupied and freed cells
+  std::vector<uint32_t> free_cells;                  // Emptied cells for reuse
+  std::unordered_map<uint64_t, uint32_t> cell_idxs;  // Cell coordinates to index into cells
+  SparseSet<Location> locations;                     // Cell and slot within it of each entity
+  std::vector<Move> moves;                           // Scratch space of update
+
+  SpatialHash() = default;
+
+  /// 21 bits per axis, cell coordinates beyond +-2^20 wrap around and share cells which the queries filter anyway
+  static uint64_t key(const int32_t x, const int32_t y, const int32_t z) {
+    const uint64_t mask = (uint64_t(1) << 21) - 1;
+    return (uint64_t(x) & mask) | ((uint64_t(y) & mask) << 21) | ((uint64_t(z) & mask) << 42);
+  }
+
+  int32_t cell_coordinate(const float position) const;
+
+  /// Index of the cell, created if it is not occupied
+  uint32_t find_or_create_cell(const int32_t x, const int32_t y, const int32_t z);
+
+  /// Removes the entity from its cell, freeing the cell once empty
+  void erase(const Location location);
+
+  void insert(const ID id, const uint32_t cell, const Vec3f& position);
+
+  /// Runs func(const Cell&) for every occupied cell overlapping the box
+  template<typename F>
+  void for_each_cell(const Vec3f& min, const Vec3f& max, F func) const;
+};
+
+#endif // MEINEKRAFT_SPATIALHASH_H
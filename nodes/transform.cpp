@@ -0,0 +1,197 @@
+#include "transform.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "../util/jobsystem.h"
+
+const size_t TransformSystem::no_parent;
+const uint32_t TransformSystem::propagated;
+
+void TransformSystem::compose_dirty() {
+  auto& job_system = JobSystem::instance();
+  job_system.parallel_for(0, journal.size(), 256, [&](const size_t begin, const size_t end) {
+    compose(begin, end);
+  });
+
+  if (hierarchy_changed) {
+    rebuild_hierarchy();
+  }
+
+  /// One level at a time so that all parents are done before their children, subtrees that did not change are skipped
+  size_t level_begin = 0;
+  for (const size_t level_end : level_ends) {
+    job_system.parallel_for(level_begin, level_end, 256, [&](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        const size_t slot = hierarchy[i];
+        const size_t parent = parents[slot];
+        if (!journal_pos[slot] && !journal_pos[parent]) { continue; }
+        data[slot].matrix = locals[slot].matrix * data[parent].matrix;
+        if (!journal_pos[slot]) { journal_pos[slot] = propagated; }
+      }
+    });
+    level_begin = level_end;
+  }
+
+  /// Children that moved along with their parents join the journal
+  for (const size_t slot : hierarchy) {
+    if (journal_pos[slot] != propagated) { continue; }
+    journal.push_back(TransformChange{slots.id_at(slot), slot});
+    journal_pos[slot] = uint32_t(journal.size());
+  }
+}
+
+void TransformSystem::rebuild_hierarchy() {
+  /// Depth of each transform, the roots are at depth 0
+  std::vector<uint32_t> depths(parents.size(), 0);
+  std::vector<uint8_t> known(parents.size(), 0);
+  std::vector<size_t> chain;
+  uint32_t max_depth = 0;
+  for (size_t slot = 0; slot < parents.size(); slot++) {
+    size_t idx = slot;
+    while (!known[idx] && parents[idx] != no_parent) {
+      chain.push_back(idx);
+      idx = parents[idx];
+    }
+    known[idx] = 1;
+    uint32_t depth = depths[idx];
+    while (!chain.empty()) {
+      depths[chain.back()] = ++depth;
+      known[chain.back()] = 1;
+      chain.pop_back();
+    }
+    if (depths[slot] > max_depth) { max_depth = depths[slot]; }
+  }
+
+  /// Counting sort by depth, level_ends[d - 1] is the end of depth d
+  level_ends.assign(max_depth, 0);
+  for (size_t slot = 0; slot < parents.size(); slot++) {
+    if (depths[slot] > 0) { level_ends[depths[slot] - 1]++; }
+  }
+  size_t end = 0;
+  for (auto& level_end : level_ends) {
+    end += level_end;
+    level_end = end;
+  }
+  hierarchy.resize(end);
+  std::vector<size_t> level_offsets(max_depth, 0);
+  for (size_t d = 1; d < max_depth; d++) {
+    level_offsets[d] = level_ends[d - 1];
+  }
+  for (size_t slot = 0; slot < parents.size(); slot++) {
+    if (depths[slot] > 0) { hierarchy[level_offsets[depths[slot] - 1]++] = slot; }
+  }
+  hierarchy_changed = false;
+}
+
+/// Rotation matrix entries of a unit quaternion, shared by the scalar and SIMD paths so that both compute the same
+/// r00 = 1 - 2(yy + zz)  r01 = 2(xy - wz)      r02 = 2(xz + wy)
+/// r10 = 2(xy + wz)      r11 = 1 - 2(xx + zz)  r12 = 2(yz - wx)
+/// r20 = 2(xz - wy)      r21 = 2(yz + wx)      r22 = 1 - 2(xx + yy)
+void TransformSystem::compose_slot(const size_t slot) {
+  const float x = rotation_x[slot], y = rotation_y[slot], z = rotation_z[slot], w = rotation_w[slot];
+  const float x2 = x * 2.0f, y2 = y * 2.0f, z2 = z * 2.0f;
+  const float xx = x * x2, yy = y * y2, zz = z * z2;
+  const float xy = x * y2, xz = x * z2, yz = y * z2;
+  const float wx = w * x2, wy = w * y2, wz = w * z2;
+  const float sx = scale_x[slot], sy = scale_y[slot], sz = scale_z[slot];
+
+  // Rows of the stored matrix are the columns of the GL matrix, thus each row is a scaled column of the rotation
+  Mat4f& matrix = composed(slot).matrix;
+  matrix[0] = Vec4f{(1.0f - (yy + zz)) * sx, (xy + wz) * sx, (xz - wy) * sx, 0.0f};
+  matrix[1] = Vec4f{(xy - wz) * sy, (1.0f - (xx + zz)) * sy, (yz + wx) * sy, 0.0f};
+  matrix[2] = Vec4f{(xz + wy) * sz, (yz - wx) * sz, (1.0f - (xx + yy)) * sz, 0.0f};
+  matrix[3] = Vec4f{position_x[slot], position_y[slot], position_z[slot], 1.0f};
+}
+
+#if defined(__AVX2__)
+/// Transposes 8 vectors of 8 floats in place
+static inline void transpose8(__m256 (&r)[8]) {
+  const __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+  const __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+  const __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+  const __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+  const __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+  const __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+  const __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+  const __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+  const __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  const __m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+  const __m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+  const __m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+  r[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+  r[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+  r[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+  r[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+  r[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+  r[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+  r[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+  r[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+#endif
+
+void TransformSystem::compose(const size_t begin, const size_t end) {
+  size_t i = begin;
+#if defined(__AVX2__)
+  /// Eight transforms at a time, one per lane, gathered from the slots in the journal
+  const __m256 one  = _mm256_set1_ps(1.0f);
+  const __m256 two  = _mm256_set1_ps(2.0f);
+  const __m256 zero = _mm256_setzero_ps();
+  for (; i + 8 <= end; i += 8) {
+    alignas(32) int32_t slots[8];
+    for (size_t lane = 0; lane < 8; lane++) {
+      slots[lane] = int32_t(journal[i + lane].slot);
+    }
+    const __m256i idx = _mm256_load_si256(reinterpret_cast<const __m256i*>(slots));
+
+    const __m256 x = _mm256_i32gather_ps(rotation_x.data(), idx, 4);
+    const __m256 y = _mm256_i32gather_ps(rotation_y.data(), idx, 4);
+    const __m256 z = _mm256_i32gather_ps(rotation_z.data(), idx, 4);
+    const __m256 w = _mm256_i32gather_ps(rotation_w.data(), idx, 4);
+    const __m256 x2 = _mm256_mul_ps(x, two), y2 = _mm256_mul_ps(y, two), z2 = _mm256_mul_ps(z, two);
+    const __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+    const __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+    const __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+    const __m256 sx = _mm256_i32gather_ps(scale_x.data(), idx, 4);
+    const __m256 sy = _mm256_i32gather_ps(scale_y.data(), idx, 4);
+    const __m256 sz = _mm256_i32gather_ps(scale_z.data(), idx, 4);
+
+    /// Component k of the matrices of all eight lanes, transposed into the first and last eight floats of each matrix
+    __m256 lo[8] = {
+      _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx),
+      _mm256_mul_ps(_mm256_add_ps(xy, wz), sx),
+      _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx),
+      zero,
+      _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy),
+      _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy),
+      _mm256_mul_ps(_mm256_add_ps(yz, wx), sy),
+      zero
+    };
+    __m256 hi[8] = {
+      _mm256_mul_ps(_mm256_add_ps(xz, wy), sz),
+      _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz),
+      _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz),
+      zero,
+      _mm256_i32gather_ps(position_x.data(), idx, 4),
+      _mm256_i32gather_ps(position_y.data(), idx, 4),
+      _mm256_i32gather_ps(position_z.data(), idx, 4),
+      one
+    };
+    transpose8(lo);
+    transpose8(hi);
+    for (size_t lane = 0; lane < 8; lane++) {
+      float* matrix = composed(size_t(slots[lane])).matrix.data();
+      _mm256_storeu_ps(matrix, lo[lane]);
+      _mm256_storeu_ps(matrix + 8, hi[lane]);
+    }
+  }
+#endif
+  for (; i < end; i++) {
+    compose_slot(journal[i].slot);
+  }
+}
@@ -2,8 +2,13 @@
 #ifndef MEINEKRAFT_TRANSFORM_H
 #define MEINEKRAFT_TRANSFORM_H
 
-#include <unordered_map>
+#include <cstdint>
+#include <string>
+#include <mutex>
 #include "../render/primitives.h"
+#include "../util/logging.h"
+#include "../math/quaternion.h"
+#include "../util/sparseset.h"
 
 struct Transform {
   Mat4f matrix;
@@ -13,20 +18,103 @@ struct Transform {
 
 struct TransformComponent {
   Vec3f position = Vec3f(0.0f, 0.0f, 0.0f);
-  // TODO: Rotation
-  float scale = 1.0f;
+  quat rotation  = quat();                   // Unit quaternion
+  Vec3f scale    = Vec3f(1.0f, 1.0f, 1.0f);
 };
 
-static Transform compute_transform(const TransformComponent& comp) {
-  return Transform(Mat4f().translate(comp.position).scale(comp.scale));
-}
+/// Entry of the per-frame change journal of the TransformSystem
+struct TransformChange {
+  ID entity_id;
+  size_t slot;  // Index of the modified Transform in the TransformSystem
+};
 
+/// Transforms are packed into the slots [0, size) of the arrays below. Slots only move when a transform is removed,
+/// which is a structural change done while no systems run, so that lookups and modifications of different entities
+/// can happen concurrently from multiple jobs.
+/// Position, rotation and scale are stored as structure of arrays, the matrices in data are composed
+/// from them in batch by compose_dirty for the transforms modified during the frame.
+/// Transforms with a parent are relative to it, their world matrices are propagated down the hierarchy level by level.
 struct TransformSystem {
 private:
-  std::vector<ID> data_ids;             // Entity ID for each Transform in data
-  std::vector<Transform> data;          // Raw data storage
-  std::unordered_map<ID, ID> data_idxs; // Entity ID to index into data
-  size_t dirty_idx = 0;                 // Number of modified Transforms
+  SparseIndex slots;                    // Entity ID to index into data and back
+  std::vector<Transform> data;          // Composed matrices, translation * rotation * scale
+  std::vector<uint32_t> journal_pos;    // Position + 1 of the slot in the journal, 0 if the Transform is not modified
+  std::vector<TransformChange> journal; // Transforms modified since the last reset_dirty, each at most once
+  std::mutex dirty_lock;                // Guards journal_pos and journal
+
+  /// Components of the transforms, indexed the same as data
+  std::vector<float> position_x, position_y, position_z;
+  std::vector<float> rotation_x, rotation_y, rotation_z, rotation_w;
+  std::vector<float> scale_x, scale_y, scale_z;
+
+  /// Hierarchy, data holds world matrices and locals the local matrices of the transforms with a parent
+  static const size_t no_parent = SIZE_MAX;
+  static const uint32_t propagated = UINT32_MAX; // journal_pos of a transform moved by its parent, not yet in the journal
+  std::vector<size_t> parents;          // Slot of the parent for each slot, no_parent for roots
+  std::vector<uint32_t> child_counts;   // Number of children of each slot
+  std::vector<Transform> locals;
+  std::vector<size_t> hierarchy;        // Slots of the transforms with a parent sorted by depth, parents first
+  std::vector<size_t> level_ends;       // End of each depth level in hierarchy, starting with the children of roots
+  bool hierarchy_changed = false;
+
+  /// Sorts the transforms with a parent by depth into hierarchy
+  void rebuild_hierarchy();
+
+  /// Matrix written by compose, the world matrix for roots and the local matrix otherwise
+  Transform& composed(const size_t slot) {
+    return parents[slot] == no_parent ? data[slot] : locals[slot];
+  }
+
+  /// Composes the matrices of the slots in the journal range [begin, end)
+  void compose(const size_t begin, const size_t end);
+
+  /// Scalar composition of a single slot
+  void compose_slot(const size_t slot);
+
+  void mark_dirty(const ID id, const size_t idx) {
+    std::lock_guard<std::mutex> lk(dirty_lock);
+    if (journal_pos[idx]) { return; } // If transform is already dirty
+    journal.push_back(TransformChange{id, idx});
+    journal_pos[idx] = uint32_t(journal.size());
+  }
+
+  /// Bulk version of mark_dirty, takes the lock once for all the slots
+  void mark_dirty(const ID* ids, const size_t* idxs, const size_t count) {
+    std::lock_guard<std::mutex> lk(dirty_lock);
+    for (size_t i = 0; i < count; i++) {
+      if (journal_pos[idxs[i]]) { continue; }
+      journal.push_back(TransformChange{ids[i], idxs[i]});
+      journal_pos[idxs[i]] = uint32_t(journal.size());
+    }
+  }
+
+  /// Removes the slot from the journal by moving the last change into its place
+  void unjournal(const size_t idx) {
+    const uint32_t pos = journal_pos[idx];
+    if (pos == 0 || pos == propagated) { return; }
+    journal_pos[idx] = 0;
+    swap_remove(journal, pos - 1);
+    if (pos - 1 < journal.size()) { journal_pos[journal[pos - 1].slot] = pos; }
+  }
+
+  /// Children of the slot become roots, keeping their local transform as their world transform
+  void orphan_children(const size_t idx) {
+    if (child_counts[idx] == 0) { return; }
+    for (size_t slot = 0; slot < parents.size(); slot++) {
+      if (parents[slot] != idx) { continue; }
+      parents[slot] = no_parent;
+      mark_dirty(slots.id_at(slot), slot);
+    }
+    child_counts[idx] = 0;
+    hierarchy_changed = true;
+  }
+
+  /// Slot of the entity, returns false for a non-existant ID
+  bool find_slot(const ID id, size_t& idx) const {
+    idx = slots.find(id);
+    return idx != SparseIndex::npos;
+  }
+
 public:
   /// Singleton instance of TransformSystem
   static TransformSystem& instance() {
@@ -34,64 +122,260 @@ public:
     return instance;
   }
 
+  /// Starts a new journal, called once per frame after the journal has been consumed
   void reset_dirty() {
-    dirty_idx = 0;
+    for (const auto& change : journal) {
+      journal_pos[change.slot] = 0;
+    }
+    journal.clear();
   }
 
-  std::vector<ID> get_dirty_transforms() const {
-    std::vector<ID> dirty_ids(dirty_idx);
-    for (size_t i = 0; i < dirty_idx; i++) {
-      dirty_ids[i] = data_ids[i];
-    }
-    return dirty_ids;
+  /// Transforms modified since the last reset_dirty
+  const std::vector<TransformChange>& get_journal() const {
+    return journal;
+  }
+
+  /// Transform in the slot given by a TransformChange of the current journal
+  const Transform& at(const size_t slot) const {
+    return data[slot];
+  }
+
+  /// Transform of the entity, nullptr for a non-existant ID
+  const Transform* find(const ID id) const {
+    size_t idx = 0;
+    return find_slot(id, idx) ? &data[idx] : nullptr;
   }
 
   std::vector<ID> get_dirty_transforms_from(const std::vector<ID>& ids) const {
-    std::vector<ID> dirty_ids;
+    std::vector<ID> dirty;
     for (const auto& id : ids) {
-      if (data_idxs.at(id) <= dirty_idx) {
-        dirty_ids.emplace_back(id);
+      size_t idx = 0;
+      if (find_slot(id, idx) && journal_pos[idx]) {
+        dirty.emplace_back(id);
       }
     }
-    return dirty_ids;
+    return dirty;
   }
 
   /// Looking up with a non-existant ID returns the first element in the data
-  Transform lookup(const ID id) {
-    return data[data_idxs[id]]; 
+  /// The matrix reflects the components as of the last compose_dirty
+  Transform lookup(const ID id) const {
+    size_t idx = 0;
+    return find_slot(id, idx) ? data[idx] : data.front();
   }
 
-  void set_transform(const Transform& transform, const ID id) {
-    if (data_idxs[id] <= dirty_idx) { // If transform is already dirty
-      data[data_idxs[id]] = transform;
-      return;
+  /// Looking up with a non-existant ID returns the default component
+  TransformComponent lookup_component(const ID id) const {
+    TransformComponent component;
+    size_t idx = 0;
+    if (!find_slot(id, idx)) { return component; }
+    component.position = Vec3f(position_x[idx], position_y[idx], position_z[idx]);
+    component.rotation = quat(Vec3f(rotation_x[idx], rotation_y[idx], rotation_z[idx]), rotation_w[idx]);
+    component.scale = Vec3f(scale_x[idx], scale_y[idx], scale_z[idx]);
+    return component;
+  }
+
+  /// Setters are thread safe as long as no two threads modify the same entity at once
+  void set_position(const Vec3f& position, const ID id) {
+    size_t idx = 0;
+    if (!find_slot(id, idx)) { return; }
+    position_x[idx] = position.x;
+    position_y[idx] = position.y;
+    position_z[idx] = position.z;
+    mark_dirty(id, idx);
+  }
+
+  /// Bulk version of set_position for behaviours, non-existant IDs are skipped
+  void set_positions(const ID* ids, const Vec3f* positions, const size_t count) {
+    const size_t batch_size = 256;
+    ID batch_ids[batch_size];
+    size_t batch_idxs[batch_size];
+    size_t batch_count = 0;
+    for (size_t i = 0; i < count; i++) {
+      size_t idx = 0;
+      if (!find_slot(ids[i], idx)) { continue; }
+      position_x[idx] = positions[i].x;
+      position_y[idx] = positions[i].y;
+      position_z[idx] = positions[i].z;
+      batch_ids[batch_count] = ids[i];
+      batch_idxs[batch_count] = idx;
+      if (++batch_count == batch_size) {
+        mark_dirty(batch_ids, batch_idxs, batch_count);
+        batch_count = 0;
+      }
     }
-    if (dirty_idx < data.size() - 1) {
-      dirty_idx++;
+    mark_dirty(batch_ids, batch_idxs, batch_count);
+  }
+
+  void set_rotation(const quat& rotation, const ID id) {
+    size_t idx = 0;
+    if (!find_slot(id, idx)) { return; }
+    rotation_x[idx] = rotation.v.x;
+    rotation_y[idx] = rotation.v.y;
+    rotation_z[idx] = rotation.v.z;
+    rotation_w[idx] = rotation.w;
+    mark_dirty(id, idx);
+  }
+
+  void set_scale(const Vec3f& scale, const ID id) {
+    size_t idx = 0;
+    if (!find_slot(id, idx)) { return; }
+    scale_x[idx] = scale.x;
+    scale_y[idx] = scale.y;
+    scale_z[idx] = scale.z;
+    mark_dirty(id, idx);
+  }
+
+  void set_component(const TransformComponent& component, const ID id) {
+    size_t idx = 0;
+    if (!find_slot(id, idx)) { return; }
+    write_component(component, idx);
+    mark_dirty(id, idx);
+  }
+
+  /// Bulk version of set_component, e.g for sampled animations, non-existant IDs are skipped
+  void set_components(const ID* ids, const TransformComponent* components, const size_t count) {
+    const size_t batch_size = 256;
+    ID batch_ids[batch_size];
+    size_t batch_idxs[batch_size];
+    size_t batch_count = 0;
+    for (size_t i = 0; i < count; i++) {
+      size_t idx = 0;
+      if (!find_slot(ids[i], idx)) { continue; }
+      write_component(components[i], idx);
+      batch_ids[batch_count] = ids[i];
+      batch_idxs[batch_count] = idx;
+      if (++batch_count == batch_size) {
+        mark_dirty(batch_ids, batch_idxs, batch_count);
+        batch_count = 0;
+      }
+    }
+    mark_dirty(batch_ids, batch_idxs, batch_count);
+  }
+
+  /// Composes the matrices of all the transforms in the journal in parallel, then propagates the world matrices
+  /// down the hierarchy. Children of modified transforms are added to the journal.
+  /// Run after the transforms of the frame have been modified and before the journal is consumed
+  void compose_dirty();
+
+  /// Makes the transform of the child relative to the one of the parent, a parent of 0 makes it a root again
+  /// Not thread safe, change the hierarchy while no systems are running
+  void set_parent(const ID child, const ID parent) {
+    size_t child_idx = 0;
+    if (!find_slot(child, child_idx)) { return; }
+    size_t parent_idx = no_parent;
+    if (parent != 0) {
+      if (!find_slot(parent, parent_idx)) { return; }
+      for (size_t idx = parent_idx; idx != no_parent; idx = parents[idx]) {
+        if (idx == child_idx) {
+          Log::warn("Tried to parent entity " + std::to_string(child) + " to one of its descendants");
+          return;
+        }
+      }
     }
-    if (data.size() >= 2) {
-      data[data_idxs[id]] = data[dirty_idx]; // Move clean data to previous location
-      data[dirty_idx] = transform;
-      // Swap idxs
-      const ID old_idx = data_idxs[id];
-      data_idxs[id] = dirty_idx;
-      data_idxs[data_ids[dirty_idx]] = old_idx;
-      // Swap Entity IDs
-      std::swap(data_ids[dirty_idx], data_ids[old_idx]);
-    } 
+    if (parents[child_idx] != no_parent) { child_counts[parents[child_idx]]--; }
+    if (parent_idx != no_parent) { child_counts[parent_idx]++; }
+    parents[child_idx] = parent_idx;
+    hierarchy_changed = true;
+    mark_dirty(child, child_idx);
+  }
+
+  /// Parent of the entity, 0 if it has none
+  ID get_parent(const ID id) const {
+    size_t idx = 0;
+    if (!find_slot(id, idx) || parents[idx] == no_parent) { return 0; }
+    return slots.id_at(parents[idx]);
   }
 
   void add_component(const TransformComponent& component, const ID id) {
-    data.emplace_back(compute_transform(component));
-    data_idxs[id] = data.size() - 1;
-    data_ids.emplace_back(id);
+    if (slots.contains(id)) {
+      set_component(component, id);
+      return;
+    }
+    /// An older generation of the entity that was never removed, its slot is part of the hierarchy and journal
+    const size_t stale = slots.find_index(entity_index(id));
+    if (stale != SparseIndex::npos) { remove_component(slots.id_at(stale)); }
+    const size_t idx = slots.insert(id);
+    data.emplace_back();
+    journal_pos.emplace_back(0);
+    parents.emplace_back(no_parent);
+    child_counts.emplace_back(0);
+    locals.emplace_back();
+    for (auto array : {&position_x, &position_y, &position_z, &rotation_x, &rotation_y, &rotation_z, &rotation_w,
+                       &scale_x, &scale_y, &scale_z}) {
+      array->emplace_back(0.0f);
+    }
+    write_component(component, idx);
+    compose_slot(idx);
+    mark_dirty(id, idx); // New transforms are journaled for the consumers of the journal, e.g the SpatialHash
   }
 
+  /// O(1) unless the transform is part of a hierarchy, children of the removed transform become roots
+  /// Not thread safe, the last slot moves into the removed one thus remove while no systems are running
   void remove_component(const ID id) {
-    if (data_idxs.find(id) == data_idxs.cend()) { return; }
-    data.erase(data.cbegin() + data_idxs[id]);
-    data_idxs.erase(id);
-    // resize data?
+    size_t idx = 0;
+    if (!find_slot(id, idx)) { return; }
+    orphan_children(idx);
+    if (parents[idx] != no_parent) {
+      child_counts[parents[idx]]--;
+      hierarchy_changed = true;
+    }
+    unjournal(idx);
+
+    /// Everything referring to the last slot is pointed at the removed one, which it is moved into
+    const size_t last = data.size() - 1;
+    if (idx != last) {
+      if (journal_pos[last] && journal_pos[last] != propagated) { journal[journal_pos[last] - 1].slot = idx; }
+      if (child_counts[last] > 0) {
+        for (auto& parent : parents) {
+          if (parent == last) { parent = idx; }
+        }
+      }
+      if (child_counts[last] > 0 || parents[last] != no_parent) { hierarchy_changed = true; }
+    }
+    slots.remove(id);
+    swap_remove(data, idx);
+    swap_remove(journal_pos, idx);
+    swap_remove(parents, idx);
+    swap_remove(child_counts, idx);
+    swap_remove(locals, idx);
+    for (auto array : {&position_x, &position_y, &position_z, &rotation_x, &rotation_y, &rotation_z, &rotation_w,
+                       &scale_x, &scale_y, &scale_z}) {
+      swap_remove(*array, idx);
+    }
+  }
+
+  /// Number of transforms, all slots below it are in use
+  size_t size() const {
+    return data.size();
+  }
+
+  /// Makes room for count transforms in total, used before adding transforms in bulk
+  void reserve(const size_t count) {
+    slots.reserve(count);
+    data.reserve(count);
+    journal_pos.reserve(count);
+    parents.reserve(count);
+    child_counts.reserve(count);
+    locals.reserve(count);
+    for (auto array : {&position_x, &position_y, &position_z, &rotation_x, &rotation_y, &rotation_z, &rotation_w,
+                       &scale_x, &scale_y, &scale_z}) {
+      array->reserve(count);
+    }
+  }
+
+private:
+  void write_component(const TransformComponent& component, const size_t idx) {
+    position_x[idx] = component.position.x;
+    position_y[idx] = component.position.y;
+    position_z[idx] = component.position.z;
+    rotation_x[idx] = component.rotation.v.x;
+    rotation_y[idx] = component.rotation.v.y;
+    rotation_z[idx] = component.rotation.v.z;
+    rotation_w[idx] = component.rotation.w;
+    scale_x[idx] = component.scale.x;
+    scale_y[idx] = component.scale.y;
+    scale_z[idx] = component.scale.z;
   }
 };
 
@@ -0,0 +1,51 @@
+#pragma once
+#ifndef MEINEKRAFT_GLCOMMANDQUEUE_H
+#define MEINEKRAFT_GLCOMMANDQUEUE_H
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+/// GL work (uploads, buffer and shader creation) pushed from any thread and executed on the main thread,
+/// which owns the GL context. Each frame only runs as many commands as fit in a time budget so that
+/// spawning things mid-game spreads the GL work over several frames instead of hitching one.
+struct GLCommandQueue {
+  void push(std::function<void()> command) {
+    std::lock_guard<std::mutex> lk(mutex);
+    commands.push_back(std::move(command));
+  }
+
+  /// Runs commands in order until budget_ms has passed, returns the number of commands run
+  /// At least one command is run so that the queue makes progress even if a single command is over budget
+  /// Must be called from the main thread
+  size_t execute(const double budget_ms) {
+    using namespace std::chrono;
+    const auto start = high_resolution_clock::now();
+    size_t executed = 0;
+    std::function<void()> command;
+    do {
+      {
+        std::lock_guard<std::mutex> lk(mutex);
+        if (commands.empty()) { break; }
+        command = std::move(commands.front());
+        commands.pop_front();
+      }
+      command();
+      executed++;
+    } while (duration<double, std::milli>(high_resolution_clock::now() - start).count() < budget_ms);
+    return executed;
+  }
+
+  /// Number of commands waiting to be executed
+  size_t size() {
+    std::lock_guard<std::mutex> lk(mutex);
+    return commands.size();
+  }
+
+private:
+  std::mutex mutex;
+  std::deque<std::function<void()>> commands;
+};
+
+#endif // MEINEKRAFT_GLCOMMANDQUEUE_H
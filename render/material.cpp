@@ -0,0 +1,264 @@
+#include "material.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef WIN32
+#include <glew.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "render.h"
+#include "../util/jobsystem.h"
+
+namespace TextureManager {
+  static std::mutex mutex;
+  static std::unordered_map<ID, RawTexture> textures{};
+};
+
+void Material::load_textures(const std::vector<std::pair<Texture::Type, std::string>>& texture_info) {
+  /// Textures are decoded concurrently, the calling thread helps out until all of them are done
+  std::vector<RawTexture> textures(texture_info.size());
+  JobSystem::instance().parallel_for(0, texture_info.size(), 1, [&](const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      textures[i] = Texture::load_textures(TextureResource{texture_info[i].second});
+    }
+  });
+  for (size_t i = 0; i < texture_info.size(); i++) {
+    set_texture(texture_info[i].first, texture_info[i].second, textures[i]);
+  }
+}
+
+void Material::set_texture(const Texture::Type type, const std::string& file, const RawTexture& data) {
+  const auto resource = TextureResource{file};
+  switch (type) {
+    case Texture::Type::Diffuse:
+      diffuse_texture.data = data;
+      diffuse_texture.gl_texture_target = GL_TEXTURE_2D_ARRAY; // FIXME: Assumes texture format
+      diffuse_texture.id = resource.to_hash();
+      break;
+    case Texture::Type::MetallicRoughness:
+      metallic_roughness_texture.data = data;
+      metallic_roughness_texture.gl_texture_target = GL_TEXTURE_2D_ARRAY; // FIXME: Assumes texture format
+      metallic_roughness_texture.id = resource.to_hash();
+      break;
+    case Texture::Type::AmbientOcclusion:
+      ambient_occlusion_texture.data = data;
+      ambient_occlusion_texture.gl_texture_target = GL_TEXTURE_2D_ARRAY;
+      ambient_occlusion_texture.id = resource.to_hash();
+      break;
+    case Texture::Type::Emissive:
+      emissive_texture.data = data;
+      emissive_texture.gl_texture_target = GL_TEXTURE_2D_ARRAY;
+      emissive_texture.id = resource.to_hash();
+      break;
+     default:
+      Log::warn("Tried to load unsupported texture: " + file);
+  }
+}
+
+void Material::set_cube_map_texture(const std::vector<std::string>& faces) {
+  const auto resource = TextureResource{faces};
+  diffuse_texture.id = resource.to_hash();
+  diffuse_texture.gl_texture_target = GL_TEXTURE_CUBE_MAP_ARRAY;
+  std::lock_guard<std::mutex> lk(TextureManager::mutex);
+  diffuse_texture.data = TextureManager::textures[diffuse_texture.id];
+  if (!diffuse_texture.data.pixels) {
+    diffuse_texture.data = Texture::load_textures(resource);
+    TextureManager::textures[diffuse_texture.id] = diffuse_texture.data;
+    Log::info("Loading new cube map textures with id:" + std::to_string(diffuse_texture.id));
+  }
+}
+
+MaterialRegistry::MaterialRegistry() {
+  /// MaterialRegistry::none
+  MaterialParameters unlit;
+  unlit.shading_model = uint32_t(ShadingModel::Unlit);
+  std::fill(std::begin(unlit.layers), std::end(unlit.layers), -1);
+  materials.push_back(Entry());
+  parameters.push_back(unlit);
+  std::lock_guard<std::mutex> lk(mutex);
+  queue_material_upload();
+}
+
+MaterialHandle MaterialRegistry::add(const Material& material) {
+  /// Indexed by Texture::Type
+  const Texture* textures[4] = {
+    &material.diffuse_texture, &material.metallic_roughness_texture,
+    &material.ambient_occlusion_texture, &material.emissive_texture
+  };
+  ID texture_ids[4];
+  for (size_t type = 0; type < 4; type++) {
+    texture_ids[type] = textures[type]->data.pixels ? textures[type]->id : 0;
+  }
+  const Vec3f& scalars = material.pbr_scalar_parameters;
+  const Key key(uint32_t(material.shading_model), texture_ids[0], texture_ids[1], texture_ids[2], texture_ids[3],
+                scalars.x, scalars.y, scalars.z);
+
+  std::lock_guard<std::mutex> lk(mutex);
+  const auto found = handles.find(key);
+  if (found != handles.cend()) { return found->second; }
+
+  Entry entry;
+  MaterialParameters material_parameters;
+  material_parameters.pbr_scalar_parameters = scalars;
+  material_parameters.shading_model = uint32_t(material.shading_model);
+  for (size_t type = 0; type < 4; type++) {
+    material_parameters.layers[type] = -1;
+    if (!texture_ids[type]) { continue; }
+    const TextureLayer texture_layer = add_texture(*textures[type]);
+    entry.texture_arrays[type] = texture_layer.array;
+    material_parameters.layers[type] = texture_layer.layer;
+  }
+  if (texture_ids[0]) { entry.diffuse_target = material.diffuse_texture.gl_texture_target; }
+
+  materials.push_back(entry);
+  parameters.push_back(material_parameters);
+  const MaterialHandle handle = MaterialHandle(materials.size() - 1);
+  handles[key] = handle;
+  queue_material_upload();
+  return handle;
+}
+
+MaterialRegistry::Entry MaterialRegistry::get(const MaterialHandle material) const {
+  std::lock_guard<std::mutex> lk(mutex);
+  if (material >= materials.size()) {
+    Log::warn("Unknown material handle: " + std::to_string(material));
+    return materials[none];
+  }
+  return materials[material];
+}
+
+uint32_t MaterialRegistry::texture_unit(const int32_t texture_array) const {
+  if (texture_array < 0) { return 0; }
+  std::lock_guard<std::mutex> lk(mutex);
+  return texture_arrays[size_t(texture_array)].gl_texture_unit;
+}
+
+size_t MaterialRegistry::size() const {
+  std::lock_guard<std::mutex> lk(mutex);
+  return materials.size();
+}
+
+MaterialRegistry::TextureLayer MaterialRegistry::add_texture(const Texture& texture) {
+  const auto found = texture_layers.find(texture.id);
+  if (found != texture_layers.cend()) { return found->second; }
+
+  /// 2D textures of all types share arrays, cube maps go into cube map arrays
+  const uint32_t target = texture.gl_texture_target == GL_TEXTURE_CUBE_MAP_ARRAY ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_2D_ARRAY;
+  const uint32_t faces = std::max(texture.data.faces, 1u);
+  size_t array_idx = 0;
+  for (; array_idx < texture_arrays.size(); array_idx++) {
+    const TextureArray& array = texture_arrays[array_idx];
+    if (array.gl_texture_target == target && array.width == texture.data.width &&
+        array.height == texture.data.height && array.faces == faces) { break; }
+  }
+  if (array_idx == texture_arrays.size()) {
+    TextureArray array;
+    array.gl_texture_target = target;
+    array.width = texture.data.width;
+    array.height = texture.data.height;
+    array.faces = faces;
+    texture_arrays.push_back(array);
+  }
+
+  /// The GL commands run in order, a layer is uploaded after the growth that makes room for it
+  auto& gl_commands = Renderer::instance().gl_commands;
+  TextureArray& array = texture_arrays[array_idx];
+  const TextureLayer texture_layer{int32_t(array_idx), int32_t(array.layers++)};
+  if (array.layers > array.capacity) {
+    const uint32_t old_capacity = array.capacity;
+    array.capacity = std::max(array.layers, (uint32_t) std::ceil(array.capacity * 1.5f));
+    const uint32_t capacity = array.capacity;
+    gl_commands.push([=]() { grow_texture_array(array_idx, old_capacity, capacity); });
+  }
+  const RawTexture data = texture.data;
+  const uint32_t layer = uint32_t(texture_layer.layer);
+  gl_commands.push([=]() { upload_layer(array_idx, layer, data); });
+  texture_layers[texture.id] = texture_layer;
+  return texture_layer;
+}
+
+void MaterialRegistry::queue_material_upload() {
+  auto& gl_commands = Renderer::instance().gl_commands;
+  if (parameters.size() > gl_material_ssbo_capacity) {
+    gl_material_ssbo_capacity = std::max(parameters.size(), 2 * gl_material_ssbo_capacity);
+    const size_t capacity = gl_material_ssbo_capacity;
+    gl_commands.push([=]() { grow_material_table(capacity); });
+  }
+  gl_commands.push([=]() { upload_materials(); });
+}
+
+void MaterialRegistry::grow_texture_array(const size_t array_idx, const uint32_t old_capacity, const uint32_t capacity) {
+  TextureArray array;
+  {
+    std::lock_guard<std::mutex> lk(mutex);
+    array = texture_arrays[array_idx];
+  }
+  if (array.gl_texture == 0) {
+    array.gl_texture_unit = Renderer::get_next_free_texture_unit();
+  }
+  glActiveTexture(GL_TEXTURE0 + array.gl_texture_unit);
+
+  /// Grows the texture and copies over the old one (this seems to be the only way to do it)
+  uint32_t gl_new_texture_array = 0;
+  glGenTextures(1, &gl_new_texture_array);
+  glBindTexture(array.gl_texture_target, gl_new_texture_array);
+  glTexParameteri(array.gl_texture_target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(array.gl_texture_target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexStorage3D(array.gl_texture_target, 1, GL_RGB8, array.width, array.height, array.faces * capacity); // depth = layer faces
+  if (array.gl_texture != 0) {
+    glCopyImageSubData(array.gl_texture, array.gl_texture_target, 0, 0, 0, 0, // src parameters
+      gl_new_texture_array, array.gl_texture_target, 0, 0, 0, 0, array.width, array.height, array.faces * old_capacity);
+    glDeleteTextures(1, &array.gl_texture);
+  }
+
+  std::lock_guard<std::mutex> lk(mutex);
+  texture_arrays[array_idx].gl_texture = gl_new_texture_array;
+  texture_arrays[array_idx].gl_texture_unit = array.gl_texture_unit;
+}
+
+void MaterialRegistry::upload_layer(const size_t array_idx, const uint32_t layer, const RawTexture& data) {
+  TextureArray array;
+  {
+    std::lock_guard<std::mutex> lk(mutex);
+    array = texture_arrays[array_idx];
+  }
+  glActiveTexture(GL_TEXTURE0 + array.gl_texture_unit);
+  glBindTexture(array.gl_texture_target, array.gl_texture);
+  glTexSubImage3D(array.gl_texture_target,
+    0,                     // Mipmap number (a.k.a level)
+    0, 0, layer * array.faces, // xoffset, yoffset, zoffset = layer face
+    array.width, array.height, array.faces, // width, height, depth = faces
+    GL_RGB,                // format
+    GL_UNSIGNED_BYTE,      // type
+    data.pixels);          // pointer to data
+}
+
+void MaterialRegistry::grow_material_table(const size_t capacity) {
+  if (gl_material_ssbo == 0) {
+    glGenBuffers(1, &gl_material_ssbo);
+  }
+  /// Reallocated buffers start out empty, the following upload copies the whole table
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, gl_material_ssbo);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(MaterialParameters), nullptr, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gl_ssbo_binding_point_idx, gl_material_ssbo);
+  gl_material_ssbo_size = capacity;
+  uploaded_materials = 0;
+}
+
+void MaterialRegistry::upload_materials() {
+  /// Materials added after a growth that is still queued wait for the upload queued after it
+  std::vector<MaterialParameters> added;
+  const size_t first = uploaded_materials;
+  {
+    std::lock_guard<std::mutex> lk(mutex);
+    const size_t last = std::min(parameters.size(), gl_material_ssbo_size);
+    if (last <= first) { return; }
+    added.assign(parameters.begin() + first, parameters.begin() + last);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, gl_material_ssbo);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(MaterialParameters), added.size() * sizeof(MaterialParameters), added.data());
+  uploaded_materials = first + added.size();
+}
@@ -0,0 +1,134 @@
+#pragma once
+#ifndef MEINEKRAFT_MATERIAL_H
+#define MEINEKRAFT_MATERIAL_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "primitives.h"
+#include "texture.h"
+
+/// Handle of a material in the MaterialRegistry, doubles as the index into the GPU material table
+typedef uint32_t MaterialHandle;
+
+/// Description of a surface, registered with the MaterialRegistry which hands out a MaterialHandle for it
+struct Material {
+  ShadingModel shading_model = ShadingModel::Unlit;
+  Texture diffuse_texture;
+  Texture metallic_roughness_texture; // Used by ShadingModel::PhysicallyBased
+  Texture ambient_occlusion_texture;
+  Texture emissive_texture;
+  Vec3f pbr_scalar_parameters;        // Used by ShadingModel::PhysicallyBasedScalars (r,g,b) = (unused, roughness, metallic)
+
+  /// Blocking - decodes the textures in parallel and sets them
+  void load_textures(const std::vector<std::pair<Texture::Type, std::string>>& texture_info);
+
+  /// Sets the texture of the given type to the decoded file
+  void set_texture(const Texture::Type type, const std::string& file, const RawTexture& data);
+
+  /// Sets the diffuse texture to the cube map, decoded once and shared by all materials using the same faces
+  /// order; right, left, top, bot, back, front
+  void set_cube_map_texture(const std::vector<std::string>& faces);
+
+  void set_shading_model(const ShadingModel shading_model) {
+    this->shading_model = shading_model;
+  }
+};
+
+/// Entry of the GPU material table, std430 layout of struct Material in shaders/geometry.frag
+struct MaterialParameters {
+  Vec3f pbr_scalar_parameters;
+  uint32_t shading_model;
+  int32_t layers[4]; // Layer of each Texture::Type in its texture array, -1 if the material has no such texture
+};
+static_assert(sizeof(MaterialParameters) == 32, "MaterialParameters must match the std430 layout");
+
+/// Registry of all the materials, the parameters of which live in one shader storage buffer indexed by the
+/// MaterialHandle of each instance. Textures are stored as layers of shared texture arrays, one array per texture
+/// target and size, so that instances of a batch may use different materials.
+/// Identical materials get the same handle and identical textures (by Texture::id) the same layer.
+class MaterialRegistry {
+public:
+  /// Default material, unlit without textures
+  static const MaterialHandle none = 0;
+
+  /// Singleton instance
+  static MaterialRegistry& instance() {
+    static MaterialRegistry instance;
+    return instance;
+  }
+
+  /// Thread safe - the textures and the table entry are uploaded by GL commands queued on the Renderer, which run
+  /// within its per-frame GL budget and before any instance added afterwards is drawn
+  MaterialHandle add(const Material& material);
+
+  /// What the renderer batches on, thread safe
+  struct Entry {
+    uint32_t diffuse_target = 0;                 // GL texture target of the diffuse texture, 0 if it has none
+    int32_t texture_arrays[4] = {-1, -1, -1, -1}; // Texture array of each Texture::Type, -1 if it has none
+  };
+  Entry get(const MaterialHandle material) const;
+
+  /// Texture unit the texture array is bound to, 0 (never used) for -1, thread safe
+  uint32_t texture_unit(const int32_t texture_array) const;
+
+  size_t size() const;
+
+  uint32_t gl_ssbo_binding_point_idx = 1; // Binding point of the material table
+
+private:
+  MaterialRegistry();
+
+  /// Layers of same sized textures, grown like a std::vector
+  struct TextureArray {
+    uint32_t gl_texture_target;  // GL_TEXTURE_2D_ARRAY or GL_TEXTURE_CUBE_MAP_ARRAY
+    uint32_t width;
+    uint32_t height;
+    uint32_t faces;              // Faces per layer, 6 for cube maps
+    uint32_t layers = 0;         // # layers handed out
+    uint32_t capacity = 0;       // # layers the GL texture holds once the queued GL commands have run
+    uint32_t gl_texture = 0;     // Written by the GL commands
+    uint32_t gl_texture_unit = 0;
+  };
+
+  struct TextureLayer {
+    int32_t array;
+    int32_t layer;
+  };
+
+  /// Shading model, texture IDs and the scalars identify a material
+  typedef std::tuple<uint32_t, ID, ID, ID, ID, float, float, float> Key;
+
+  mutable std::mutex mutex;
+  std::vector<Entry> materials;
+  std::vector<MaterialParameters> parameters;        // The material table, indexed by MaterialHandle
+  std::map<Key, MaterialHandle> handles;
+  std::vector<TextureArray> texture_arrays;
+  std::unordered_map<ID, TextureLayer> texture_layers; // Texture ID to where it lives
+
+  size_t gl_material_ssbo_capacity = 0; // # materials the buffer holds once the queued GL commands have run
+
+  /// Only touched by the GL commands on the main thread
+  uint32_t gl_material_ssbo = 0;
+  size_t gl_material_ssbo_size = 0;     // # materials the buffer holds
+  size_t uploaded_materials = 0;        // Materials are immutable, only those added since the last upload are copied
+
+  /// Array and layer of the texture, allocated on first use and uploaded by a queued GL command
+  TextureLayer add_texture(const Texture& texture);
+  /// Queues the upload of the materials added to the table, growing the buffer first if they do not fit
+  void queue_material_upload();
+
+  /// GL commands, run on the main thread
+  void grow_texture_array(const size_t array_idx, const uint32_t old_capacity, const uint32_t capacity);
+  void upload_layer(const size_t array_idx, const uint32_t layer, const RawTexture& data);
+  void grow_material_table(const size_t capacity);
+  void upload_materials();
+};
+
+#endif // MEINEKRAFT_MATERIAL_H
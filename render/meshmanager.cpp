@@ -5,22 +5,13 @@
 #include "../util/filesystem.h"
 #include "../util/logging.h"
 
+#include <mutex>
+
 static std::vector<Mesh> loaded_meshes{Cube(), Cube(true), Sphere()};
+static std::mutex loaded_meshes_mutex; // Meshes are loaded on the workers
 
 // Assuming the metallic-roughness material model of models loaded with GLTF.
-std::pair<ID, std::vector<std::pair<Texture::Type, std::string>>>
-MeshManager::load_mesh(const std::string& directory, const std::string& file) {
-    MeshInformation mesh_info;
-    mesh_info.loaded_from_filepath = directory + file;
-
-    Assimp::Importer importer;
-    auto scene = importer.ReadFile(mesh_info.loaded_from_filepath.c_str(), aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
-
-    if (scene == nullptr || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) {
-        Log::error("Error: " + std::string(importer.GetErrorString()));
-        return {0, {}};
-    }
-
+static std::vector<std::pair<Texture::Type, std::string>> load_texture_info(const aiScene* scene, const std::string& directory) {
     std::vector<std::pair<Texture::Type, std::string>> texture_info;
     if (scene->HasMaterials()) {
         Log::info("Number of materials: " + std::to_string(scene->mNumMaterials));
@@ -107,52 +98,167 @@ MeshManager::load_mesh(const std::string& directory, const std::string& file) {
             }
         }
     }
+    return texture_info;
+}
+
+/// Appends the vertices and faces of the assimp mesh to the mesh
+static bool append_mesh(const aiMesh* mesh, Mesh& result) {
+    Log::info("Loading mesh with name: " + std::string(mesh->mName.data));
+    const uint32_t first_vertex = uint32_t(result.vertices.size());
+
+    for (size_t j = 0; j < mesh->mNumVertices; j++) {
+        Vertex<float> vertex;
+
+        auto pos = mesh->mVertices[j];
+        vertex.position = {pos.x, pos.y, pos.z};
+
+        if (mesh->HasTextureCoords(0)) {
+            auto tex_coord = mesh->mTextureCoords[0][j];
+            vertex.tex_coord = {tex_coord.x, -tex_coord.y}; // glTF (& .obj) has a flipped texture coordinate system compared to OpenGL 
+        }
+
+        if (mesh->HasNormals()) {
+            auto normal = mesh->mNormals[j];
+            vertex.normal = {normal.x, normal.y, normal.z};
+        }
+
+        result.vertices.push_back(vertex);
+    }
+
+    for (size_t j = 0; j < mesh->mNumFaces; j++) {
+        auto face = &mesh->mFaces[j];
+        if (face->mNumIndices != 3) {
+            Log::warn("Not 3 vertices per face in model.");
+            return false;
+        }
+        for (size_t k = 0; k < 3; k++) {
+            result.indices.push_back(first_vertex + face->mIndices[k]);
+        }
+    }
+    return true;
+}
+
+/// Adds the animations of the scene to the AnimationSystem, unnamed ones are named after the file and their index
+static std::vector<AnimationHandle> load_animations(const aiScene* scene, const std::string& filepath) {
+    std::vector<AnimationHandle> handles;
+    for (size_t i = 0; i < scene->mNumAnimations; i++) {
+        const aiAnimation* animation = scene->mAnimations[i];
+        /// Keys are in ticks, formats without a tick rate leave it at 0 and assimp suggests 25 ticks per second then
+        const double ticks_per_second = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+        AnimationClip clip;
+        clip.name = animation->mName.length > 0 ? std::string(animation->mName.C_Str()) : filepath + "#" + std::to_string(i);
+        clip.duration = float(animation->mDuration / ticks_per_second);
+        for (size_t j = 0; j < animation->mNumChannels; j++) {
+            const aiNodeAnim* node_animation = animation->mChannels[j];
+            AnimationChannel channel;
+            channel.node = node_animation->mNodeName.C_Str();
+            for (size_t k = 0; k < node_animation->mNumPositionKeys; k++) {
+                const aiVectorKey& key = node_animation->mPositionKeys[k];
+                channel.add_position(float(key.mTime / ticks_per_second), Vec3f(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            for (size_t k = 0; k < node_animation->mNumRotationKeys; k++) {
+                const aiQuatKey& key = node_animation->mRotationKeys[k];
+                const quat rotation(Vec3f(key.mValue.x, key.mValue.y, key.mValue.z), key.mValue.w);
+                channel.add_rotation(float(key.mTime / ticks_per_second), rotation);
+            }
+            for (size_t k = 0; k < node_animation->mNumScalingKeys; k++) {
+                const aiVectorKey& key = node_animation->mScalingKeys[k];
+                channel.add_scale(float(key.mTime / ticks_per_second), Vec3f(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            clip.channels.push_back(std::move(channel));
+        }
+        Log::info("Animation: " + clip.name + " # channels " + std::to_string(clip.channels.size()));
+        handles.push_back(AnimationSystem::instance().add_clip(clip));
+    }
+    return handles;
+}
+
+static ID add_loaded_mesh(const Mesh& mesh) {
+    std::lock_guard<std::mutex> lk(loaded_meshes_mutex);
+    loaded_meshes.push_back(mesh);
+    return loaded_meshes.size() - 1;
+}
+
+std::pair<ID, std::vector<std::pair<Texture::Type, std::string>>>
+MeshManager::load_mesh(const std::string& directory, const std::string& file) {
+    MeshInformation mesh_info;
+    mesh_info.loaded_from_filepath = directory + file;
+
+    Assimp::Importer importer;
+    auto scene = importer.ReadFile(mesh_info.loaded_from_filepath.c_str(), aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
+
+    if (scene == nullptr || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) {
+        Log::error("Error: " + std::string(importer.GetErrorString()));
+        return {0, {}};
+    }
+
+    const auto texture_info = load_texture_info(scene, directory);
 
     if (scene->HasMeshes()) {
-        // FIXME: Assumes the mesh is a single mesh and not a hierarchy
+        // NOTE: Flattens all the meshes into one and ignores the node hierarchy, see load_mesh_hierarchy
         Log::info("Scene: # meshes " + std::to_string(scene->mNumMeshes));
         for (size_t i = 0; i < scene->mNumMeshes; i++) {
-            auto mesh = scene->mMeshes[i];
-            Log::info("Loading mesh with name: " + std::string(mesh->mName.data));
+            if (!append_mesh(scene->mMeshes[i], mesh_info.mesh)) { return {0, {}}; }
+        }
+    }
+    // FIXME: Mesh id is worthless since it does not change or anything ...
+    return {add_loaded_mesh(mesh_info.mesh), texture_info};
+}
+
+MeshHierarchy MeshManager::load_mesh_hierarchy(const std::string& directory, const std::string& file) {
+    MeshHierarchy hierarchy;
+    const std::string filepath = directory + file;
+
+    Assimp::Importer importer;
+    auto scene = importer.ReadFile(filepath.c_str(), aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
 
-            for (size_t j = 0; j < mesh->mNumVertices; j++) {
-                Vertex<float> vertex;
+    if (scene == nullptr || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || scene->mRootNode == nullptr) {
+        Log::error("Error: " + std::string(importer.GetErrorString()));
+        return hierarchy;
+    }
 
-                auto pos = mesh->mVertices[j];
-                vertex.position = {pos.x, pos.y, pos.z};
+    hierarchy.texture_info = load_texture_info(scene, directory);
+    hierarchy.animations = load_animations(scene, filepath);
 
-                if (mesh->HasTextureCoords(0)) {
-                    auto tex_coord = mesh->mTextureCoords[0][j];
-                    vertex.tex_coord = {tex_coord.x, -tex_coord.y}; // glTF (& .obj) has a flipped texture coordinate system compared to OpenGL 
-                }
+    /// Every assimp mesh becomes a mesh of its own so that nodes can share them
+    std::vector<ID> mesh_ids(scene->mNumMeshes, 0);
+    for (size_t i = 0; i < scene->mNumMeshes; i++) {
+        Mesh mesh;
+        if (append_mesh(scene->mMeshes[i], mesh)) {
+            mesh_ids[i] = add_loaded_mesh(mesh);
+        }
+    }
 
-                if (mesh->HasNormals()) {
-                    auto normal = mesh->mNormals[j];
-                    vertex.normal = {normal.x, normal.y, normal.z};
-                }
+    /// Breadth first so that the nodes are sorted by depth with parents before their children
+    std::vector<std::pair<const aiNode*, int32_t>> queue{{scene->mRootNode, -1}};
+    for (size_t i = 0; i < queue.size(); i++) {
+        const aiNode* ai_node = queue[i].first;
+        MeshNode node;
+        node.name = ai_node->mName.C_Str();
+        node.parent = queue[i].second;
 
-                mesh_info.mesh.vertices.push_back(vertex);
-            }
+        aiVector3D scaling, position;
+        aiQuaternion rotation;
+        ai_node->mTransformation.Decompose(scaling, rotation, position);
+        node.transform.position = Vec3f(position.x, position.y, position.z);
+        node.transform.rotation = quat(Vec3f(rotation.x, rotation.y, rotation.z), rotation.w);
+        node.transform.scale = Vec3f(scaling.x, scaling.y, scaling.z);
 
-            for (size_t j = 0; j < mesh->mNumFaces; j++) {
-                auto face = &mesh->mFaces[j];
-                if (face->mNumIndices != 3) {
-                    Log::warn("Not 3 vertices per face in model.");
-                    return {0, {}};
-                }
-                for (size_t k = 0; k < 3; k++) {
-                    auto index = face->mIndices[k];
-                    mesh_info.mesh.indices.push_back(index);
-                }
-            }
+        for (size_t j = 0; j < ai_node->mNumMeshes; j++) {
+            const ID mesh_id = mesh_ids[ai_node->mMeshes[j]];
+            if (mesh_id != 0) { node.mesh_ids.push_back(mesh_id); }
         }
+        for (size_t j = 0; j < ai_node->mNumChildren; j++) {
+            queue.emplace_back(ai_node->mChildren[j], int32_t(hierarchy.nodes.size()));
+        }
+        hierarchy.nodes.push_back(node);
     }
-    // FIXME: Mesh id is worthless since it does not change or anything ...
-    loaded_meshes.push_back(mesh_info.mesh);
-    return {loaded_meshes.size() - 1, texture_info};
+    Log::info("Scene: # nodes " + std::to_string(hierarchy.nodes.size()));
+    return hierarchy;
 }
 
 Mesh MeshManager::mesh_from_id(ID id) {
+  std::lock_guard<std::mutex> lk(loaded_meshes_mutex);
   if (id < loaded_meshes.size()) {
     return loaded_meshes[id];
   } else {
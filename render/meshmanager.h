@@ -4,6 +4,8 @@
 
 #include "primitives.h"
 #include "texture.h"
+#include "../nodes/transform.h"
+#include "../nodes/animation.h"
 
 #include <vector>
 
@@ -12,9 +14,29 @@ struct MeshInformation {
     std::string loaded_from_filepath;
 };
 
+/// Node of an imported scene
+struct MeshNode {
+  std::string name;
+  int32_t parent = -1;          // Index of the parent node, -1 for the root
+  TransformComponent transform; // Relative to the parent
+  std::vector<ID> mesh_ids;
+};
+
+/// Imported scene with its node hierarchy, nodes are sorted by depth with the root first
+struct MeshHierarchy {
+  std::vector<MeshNode> nodes;
+  std::vector<std::pair<Texture::Type, std::string>> texture_info;
+  std::vector<AnimationHandle> animations; // Clips of the file, their channels are named after the nodes
+};
+
 struct MeshManager {
+  /// Loads all the meshes in the file as one mesh, without the nodes its animations would play on
   static std::pair<ID, std::vector<std::pair<Texture::Type, std::string>>>
   load_mesh(const std::string& directory, const std::string& file);
+
+  /// Loads each mesh in the file separately along with the nodes that place them, adds its animations to the
+  /// AnimationSystem
+  static MeshHierarchy load_mesh_hierarchy(const std::string& directory, const std::string& file);
   
   static Mesh mesh_from_id(ID id);
 };
@@ -303,8 +303,13 @@ struct RenderState {
   uint64_t entities        = 0;
   uint64_t graphic_batches = 0;
   uint64_t draw_calls      = 0;
+  /// Queued GL commands, executed before the frame is rendered
+  uint64_t gl_commands_executed = 0;
+  uint64_t gl_commands_backlog  = 0;
+  double gl_commands_ms         = 0.0;
   RenderState() = default;
-  RenderState(const RenderState& old): frame(old.frame) {}
+  RenderState(const RenderState& old): frame(old.frame), gl_commands_executed(old.gl_commands_executed),
+    gl_commands_backlog(old.gl_commands_backlog), gl_commands_ms(old.gl_commands_ms) {}
 };
 
 #endif // MEINEKRAFT_PRIMITIVES_H
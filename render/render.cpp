@@ -1,5 +1,8 @@
 #include "render.h"
 
+#include <algorithm>
+#include <functional>
+#include <iterator>
 #include <random>
 
 #ifdef WIN32
@@ -13,8 +16,10 @@
 #include "../util/filesystem.h"
 #include "debug_opengl.h"
 #include "rendercomponent.h"
+#include "material.h"
 #include "meshmanager.h"
 #include "../nodes/entity.h"
+#include "../util/jobsystem.h"
 
 #include <glm/common.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -266,17 +271,13 @@ void Renderer::render(uint32_t delta) {
   state = RenderState(state);
   state.frame++;
 
-  /// Renderer caches the transforms of components thus we need to fetch the ones who changed during the last frame 
-  if (state.frame % 10 == 0) { 
-    TransformSystem::instance().reset_dirty();
-  }
-  update_transforms();  
-
   /// Culls objects in all batches
   // cull_objects();
 
   glm::mat4 camera_transform = camera->transform(); 
 
+  const auto& materials = MaterialRegistry::instance();
+
   /// Geometry pass
   pass_started("Geometry pass");
   {
@@ -288,24 +289,23 @@ void Renderer::render(uint32_t delta) {
       const auto program = batch.depth_shader.gl_program;
       glUseProgram(program);
       glUniformMatrix4fv(glGetUniformLocation(program, "camera_view"), 1, GL_FALSE, glm::value_ptr(camera_transform));
+      /// Texture arrays may be picked up by the batch after it was linked
+      glUniform1i(glGetUniformLocation(program, "diffuse"), materials.texture_unit(batch.texture_arrays[size_t(Texture::Type::Diffuse)]));
+      glUniform1i(glGetUniformLocation(program, "pbr_parameters"), materials.texture_unit(batch.texture_arrays[size_t(Texture::Type::MetallicRoughness)]));
+      glUniform1i(glGetUniformLocation(program, "ambient_occlusion"), materials.texture_unit(batch.texture_arrays[size_t(Texture::Type::AmbientOcclusion)]));
+      glUniform1i(glGetUniformLocation(program, "emissive"), materials.texture_unit(batch.texture_arrays[size_t(Texture::Type::Emissive)]));
       
       glBindBuffer(GL_ARRAY_BUFFER, batch.gl_depth_models_buffer_object);
-      glBufferData(GL_ARRAY_BUFFER, batch.objects.transforms.size() * sizeof(Mat4<float>), batch.objects.transforms.data(), GL_DYNAMIC_DRAW);
+      glBufferData(GL_ARRAY_BUFFER, batch.snapshot_transforms.size() * sizeof(Mat4<float>), batch.snapshot_transforms.data(), GL_DYNAMIC_DRAW);
       
-      glBindBuffer(GL_ARRAY_BUFFER, batch.gl_diffuse_textures_layer_idx);
-      glBufferData(GL_ARRAY_BUFFER, batch.objects.diffuse_texture_idxs.size() * sizeof(uint32_t), batch.objects.diffuse_texture_idxs.data(), GL_DYNAMIC_DRAW);
-
-      glBindBuffer(GL_ARRAY_BUFFER, batch.gl_shading_model_buffer_object);
-      glBufferData(GL_ARRAY_BUFFER, batch.objects.shading_models.size() * sizeof(ShadingModel), batch.objects.shading_models.data(), GL_DYNAMIC_DRAW);
-
-      glBindBuffer(GL_ARRAY_BUFFER, batch.gl_pbr_scalar_buffer_object);
-      glBufferData(GL_ARRAY_BUFFER, batch.objects.pbr_scalar_parameters.size() * sizeof(Vec3<float>), batch.objects.pbr_scalar_parameters.data(), GL_DYNAMIC_DRAW);
+      glBindBuffer(GL_ARRAY_BUFFER, batch.gl_material_buffer_object);
+      glBufferData(GL_ARRAY_BUFFER, batch.objects.materials.size() * sizeof(MaterialHandle), batch.objects.materials.data(), GL_DYNAMIC_DRAW);
 
       glBindVertexArray(batch.gl_depth_vao);
       
-      glDrawElementsInstanced(GL_TRIANGLES, batch.mesh.indices.size(), GL_UNSIGNED_INT, nullptr, batch.objects.transforms.size());
+      glDrawElementsInstanced(GL_TRIANGLES, batch.mesh.indices.size(), GL_UNSIGNED_INT, nullptr, batch.snapshot_transforms.size());
       
-      state.entities += batch.objects.transforms.size();
+      state.entities += batch.snapshot_transforms.size();
       state.draw_calls++;
     }
   }
@@ -366,10 +366,10 @@ void Renderer::link_batch(GraphicsBatch& batch) {
     const auto program = batch.depth_shader.gl_program;
     glUseProgram(program);
     glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(projection_matrix));
-    glUniform1i(glGetUniformLocation(program, "diffuse"), batch.gl_diffuse_texture_unit);
-    glUniform1i(glGetUniformLocation(program, "pbr_parameters"), batch.gl_metallic_roughness_texture_unit);
-    glUniform1i(glGetUniformLocation(program, "ambient_occlusion"), batch.gl_ambient_occlusion_texture_unit);
-    glUniform1i(glGetUniformLocation(program, "emissive"), batch.gl_emissive_texture_unit);
+
+    /// Shader storage buffer object for the materials: bind it to the SSBO
+    GLuint gl_ssbo_block_idx = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, "MaterialBlock");
+    glShaderStorageBlockBinding(program, gl_ssbo_block_idx, MaterialRegistry::instance().gl_ssbo_binding_point_idx);
     
     glGenVertexArrays(1, &batch.gl_depth_vao);
     glBindVertexArray(batch.gl_depth_vao);
@@ -401,25 +401,12 @@ void Renderer::link_batch(GraphicsBatch& batch) {
       glVertexAttribDivisor(model_attrib + i, 1);
     }
 
-    // Buffer for all the diffuse texture indices
-    glGenBuffers(1, &batch.gl_diffuse_textures_layer_idx);
-    glBindBuffer(GL_ARRAY_BUFFER, batch.gl_diffuse_textures_layer_idx);
-    glVertexAttribIPointer(glGetAttribLocation(program, "diffuse_layer_idx"), 1, GL_UNSIGNED_INT, sizeof(GLint), nullptr);
-    glEnableVertexAttribArray(glGetAttribLocation(program, "diffuse_layer_idx"));
-    glVertexAttribDivisor(glGetAttribLocation(program, "diffuse_layer_idx"), 1);
-
-    glGenBuffers(1, &batch.gl_shading_model_buffer_object);
-    glBindBuffer(GL_ARRAY_BUFFER, batch.gl_shading_model_buffer_object);
-    glVertexAttribIPointer(glGetAttribLocation(program, "shading_model_id"), 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
-    glEnableVertexAttribArray(glGetAttribLocation(program, "shading_model_id"));
-    glVertexAttribDivisor(glGetAttribLocation(program, "shading_model_id"), 1);
-
-    // FIXME: Not all configurations needs this
-    glGenBuffers(1, &batch.gl_pbr_scalar_buffer_object);
-    glBindBuffer(GL_ARRAY_BUFFER, batch.gl_pbr_scalar_buffer_object);
-    glVertexAttribPointer(glGetAttribLocation(program, "pbr_scalar_parameters"), 3, GL_FLOAT, GL_FALSE, sizeof(Vec3<float>), nullptr);
-    glEnableVertexAttribArray(glGetAttribLocation(program, "pbr_scalar_parameters"));
-    glVertexAttribDivisor(glGetAttribLocation(program, "pbr_scalar_parameters"), 1);
+    // Buffer for the material of each instance, indexes the material table
+    glGenBuffers(1, &batch.gl_material_buffer_object);
+    glBindBuffer(GL_ARRAY_BUFFER, batch.gl_material_buffer_object);
+    glVertexAttribIPointer(glGetAttribLocation(program, "material_idx"), 1, GL_UNSIGNED_INT, sizeof(MaterialHandle), nullptr);
+    glEnableVertexAttribArray(glGetAttribLocation(program, "material_idx"));
+    glVertexAttribDivisor(glGetAttribLocation(program, "material_idx"), 1);
 
     GLuint EBO;
     glGenBuffers(1, &EBO);
@@ -429,104 +416,75 @@ void Renderer::link_batch(GraphicsBatch& batch) {
 }
 
 void Renderer::add_component(const RenderComponent comp, const ID entity_id) {
-  // Handle the config of the Shader from the component
+  gl_commands.push([=]() { add_to_batch(comp, entity_id); });
+}
+
+void Renderer::add_components(std::vector<std::pair<ID, RenderComponent>>& components) {
+  for (size_t begin = 0; begin < components.size(); begin += gl_command_batch_size) {
+    const size_t end = std::min(begin + gl_command_batch_size, components.size());
+    auto batch = std::make_shared<std::vector<std::pair<ID, RenderComponent>>>(
+      std::make_move_iterator(components.begin() + begin), std::make_move_iterator(components.begin() + end));
+    gl_commands.push([=]() {
+      for (const auto& component : *batch) {
+        add_to_batch(component.second, component.first);
+      }
+    });
+  }
+  components.clear();
+}
+
+void Renderer::execute_gl_commands() {
+  using namespace std::chrono;
+  const auto start = high_resolution_clock::now();
+  state.gl_commands_executed = gl_commands.execute(gl_command_budget_ms);
+  state.gl_commands_ms = duration<double, std::milli>(high_resolution_clock::now() - start).count();
+  state.gl_commands_backlog = gl_commands.size();
+}
+
+void Renderer::add_to_batch(const RenderComponent& comp, const ID entity_id) {
+  const MaterialRegistry::Entry material = MaterialRegistry::instance().get(comp.material);
+
+  // Handle the config of the Shader from the material
   std::set<Shader::Defines> comp_shader_config;
 
-  if (comp.diffuse_texture.data.pixels) {
-    switch (comp.diffuse_texture.gl_texture_target) {
-    case GL_TEXTURE_2D_ARRAY:
-      comp_shader_config.insert(Shader::Defines::Diffuse2D);
-      break;
-    case GL_TEXTURE_CUBE_MAP_ARRAY:
-      comp_shader_config.insert(Shader::Defines::DiffuseCubemap);
-      break;
-    default:
-      Log::error("Depth shader diffuse texture type not handled.");
-    }
+  switch (material.diffuse_target) {
+  case 0:
+    break; // No diffuse texture
+  case GL_TEXTURE_2D_ARRAY:
+    comp_shader_config.insert(Shader::Defines::Diffuse2D);
+    break;
+  case GL_TEXTURE_CUBE_MAP_ARRAY:
+    comp_shader_config.insert(Shader::Defines::DiffuseCubemap);
+    break;
+  default:
+    Log::error("Depth shader diffuse texture type not handled.");
   }
 
-  // Shader configuration and mesh id defines the uniqueness of a GBatch
+  // Shader configuration and mesh id defines the uniqueness of a GBatch, the materials are looked up per instance
   for (auto& batch : graphics_batches) {
     if (batch.mesh_id != comp.mesh_id) { continue; }
     if (comp_shader_config != batch.depth_shader.defines) { continue; }
-    if (comp.diffuse_texture.data.pixels) {
-      bool batch_contains_texture = batch.layer_idxs.count(comp.diffuse_texture.id) == 0;
-      if (!batch_contains_texture) {
-        batch.objects.diffuse_texture_idxs.push_back(batch.layer_idxs[comp.diffuse_texture.id]);
-      } else {
-        /// Expand texture buffer if needed
-        if (batch.diffuse_textures_count + 1 > batch.diffuse_textures_capacity) {
-          batch.expand_texture_buffer(comp.diffuse_texture, &batch.gl_diffuse_texture_array, &batch.diffuse_textures_capacity, batch.gl_diffuse_texture_unit);
-        }
-
-        /// Update the mapping from texture id to layer idx and increment count
-        batch.layer_idxs[comp.diffuse_texture.id] = batch.diffuse_textures_count++;
-        batch.objects.diffuse_texture_idxs.push_back(batch.layer_idxs[comp.diffuse_texture.id]);
-
-        /// Upload the texture to OpenGL
-        batch.upload(comp.diffuse_texture, batch.gl_diffuse_texture_unit, batch.gl_diffuse_texture_array);
-      }
+    bool samples_other_arrays = false;
+    for (size_t type = 0; type < 4; type++) {
+      const int32_t array = material.texture_arrays[type];
+      samples_other_arrays |= array >= 0 && batch.texture_arrays[type] >= 0 && batch.texture_arrays[type] != array;
     }
-    add_graphics_state(batch, comp, entity_id);
+    if (samples_other_arrays) { continue; }
+    for (size_t type = 0; type < 4; type++) {
+      if (batch.texture_arrays[type] < 0) { batch.texture_arrays[type] = material.texture_arrays[type]; }
+    }
+    add_graphics_state(batch, uint32_t(&batch - graphics_batches.data()), comp, entity_id);
     return;
   }
 
   GraphicsBatch batch{comp.mesh_id};
   batch.mesh = MeshManager::mesh_from_id(comp.mesh_id);
+  std::copy(std::begin(material.texture_arrays), std::end(material.texture_arrays), std::begin(batch.texture_arrays));
 
   /// Batch shader prepass (depth pass) shader creation process
   batch.depth_shader = Shader{ Filesystem::base + "shaders/geometry.vert", Filesystem::base + "shaders/geometry.frag" };
   batch.depth_shader.defines = comp_shader_config;
 
-  if (comp.diffuse_texture.data.pixels) {
-    batch.gl_diffuse_texture_unit = Renderer::get_next_free_texture_unit();
-
-    batch.init_buffer(comp.diffuse_texture, &batch.gl_diffuse_texture_array, batch.gl_diffuse_texture_unit, &batch.diffuse_textures_capacity);
-
-    /// Update the mapping from texture id to layer idx and increment count
-    batch.layer_idxs[comp.diffuse_texture.id] = batch.diffuse_textures_count++;
-    batch.objects.diffuse_texture_idxs.push_back(batch.layer_idxs[comp.diffuse_texture.id]);
-
-    /// Upload the texture to OpenGL
-    batch.upload(comp.diffuse_texture, batch.gl_diffuse_texture_unit, batch.gl_diffuse_texture_array);
-  }
-
-  if (comp.metallic_roughness_texture.data.pixels) {
-    const Texture& texture = comp.metallic_roughness_texture;
-    batch.gl_metallic_roughness_texture_unit = Renderer::get_next_free_texture_unit();
-    glActiveTexture(GL_TEXTURE0 + batch.gl_metallic_roughness_texture_unit);
-    uint32_t gl_metallic_roughness_texture = 0;
-    glGenTextures(1, &gl_metallic_roughness_texture);
-    glBindTexture(texture.gl_texture_target, gl_metallic_roughness_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(texture.gl_texture_target, 0, GL_RGB, texture.data.width, texture.data.height, 0, GL_RGB, GL_UNSIGNED_BYTE, texture.data.pixels);
-  }
-
-  if (comp.ambient_occlusion_texture.data.pixels) {
-    const Texture& texture = comp.ambient_occlusion_texture;
-    batch.gl_ambient_occlusion_texture_unit = Renderer::get_next_free_texture_unit();
-    glActiveTexture(GL_TEXTURE0 + batch.gl_ambient_occlusion_texture_unit);
-    uint32_t gl_ambient_occlusion_texture = 0;
-    glGenTextures(1, &gl_ambient_occlusion_texture);
-    glBindTexture(texture.gl_texture_target, gl_ambient_occlusion_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(texture.gl_texture_target, 0, GL_RGB, texture.data.width, texture.data.height, 0, GL_RGB, GL_UNSIGNED_BYTE, texture.data.pixels);
-  }
-
-  if (comp.emissive_texture.data.pixels) {
-    const Texture& texture = comp.emissive_texture;
-    batch.gl_emissive_texture_unit = Renderer::get_next_free_texture_unit();
-    glActiveTexture(GL_TEXTURE0 + batch.gl_emissive_texture_unit);
-    uint32_t gl_emissive_texture = 0;
-    glGenTextures(1, &gl_emissive_texture);
-    glBindTexture(texture.gl_texture_target, gl_emissive_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(texture.gl_texture_target, 0, GL_RGB, texture.data.width, texture.data.height, 0, GL_RGB, GL_UNSIGNED_BYTE, texture.data.pixels);
-  }
-
   std::string err_msg;
   bool success;
   std::tie(success, err_msg) = batch.depth_shader.compile();
@@ -537,37 +495,89 @@ void Renderer::add_component(const RenderComponent comp, const ID entity_id) {
 
   link_batch(batch);
 
-  add_graphics_state(batch, comp, entity_id);
+  add_graphics_state(batch, uint32_t(graphics_batches.size()), comp, entity_id);
   graphics_batches.push_back(batch);
 }
 
 void Renderer::remove_component(ID entity_id) {
-  // TODO: Implement
+  gl_commands.push([=]() { remove_from_batch(entity_id); });
+}
+
+void Renderer::remove_from_batch(const ID entity_id) {
+  const InstanceRef* ref = instance_refs.find(entity_id);
+  if (!ref) { return; }
+  /// Scaling by zero collapses the instance to a point until the slot is compacted away
+  const Transform hidden(Mat4f().scale(0.0f));
+  GraphicsBatch& batch = graphics_batches[ref->batch];
+  batch.objects.transforms[ref->slot] = hidden;
+  batch.snapshot_transforms[ref->slot] = hidden;
+  batch.removed_slots.push_back(ref->slot);
+  instance_refs.remove(entity_id);
+}
+
+void Renderer::compact_batches() {
+  for (auto& batch : graphics_batches) {
+    if (batch.removed_slots.empty()) { continue; }
+    /// Highest slot first so that the last instance moved into a hole is never one that is removed as well
+    std::sort(batch.removed_slots.begin(), batch.removed_slots.end(), std::greater<uint32_t>());
+    auto& objects = batch.objects;
+    for (const uint32_t slot : batch.removed_slots) {
+      swap_remove(batch.entity_ids, slot);
+      swap_remove(objects.transforms, slot);
+      swap_remove(batch.snapshot_transforms, slot);
+      swap_remove(objects.materials, slot);
+      if (slot < batch.entity_ids.size()) {
+        instance_refs.find(batch.entity_ids[slot])->slot = slot;
+      }
+    }
+    batch.removed_slots.clear();
+
+    /// Only give memory back after large removals, e.g unloading chunks, the instance buffers are sized each frame
+    if (batch.entity_ids.capacity() > 2 * batch.entity_ids.size() + 1024) {
+      batch.entity_ids.shrink_to_fit();
+      objects.transforms.shrink_to_fit();
+      batch.snapshot_transforms.shrink_to_fit();
+      objects.materials.shrink_to_fit();
+      batch.removed_slots.shrink_to_fit();
+    }
+  }
 }
 
-void Renderer::add_graphics_state(GraphicsBatch& batch, const RenderComponent& comp, ID entity_id) {
+void Renderer::add_graphics_state(GraphicsBatch& batch, const uint32_t batch_idx, const RenderComponent& comp, ID entity_id) {
   batch.entity_ids.push_back(entity_id);
-  batch.data_idx[entity_id] = batch.entity_ids.size() - 1;
+  instance_refs.insert(entity_id, InstanceRef{batch_idx, uint32_t(batch.entity_ids.size() - 1)});
   batch.objects.transforms.push_back(TransformSystem::instance().lookup(entity_id));
-  batch.objects.pbr_scalar_parameters.push_back(comp.pbr_scalar_parameters);
-  batch.objects.shading_models.push_back(comp.shading_model);
+  batch.snapshot_transforms.push_back(batch.objects.transforms.back());
+  batch.objects.materials.push_back(comp.material);
 }
 
 void Renderer::update_transforms() {
-  std::vector<ID> job_ids(graphics_batches.size());
-  const std::vector<ID> t_ids = TransformSystem::instance().get_dirty_transforms();
-  // Log::info("Dirty ids: " + std::to_string(t_ids.size()));
-  for (size_t i = 0; i < graphics_batches.size(); i++) {
-    ID job_id = JobSystem::instance().execute([=](){ // FIXME: Remove the copy of t_ids
-      auto& batch = graphics_batches[i];
-      for (const auto& t_id : t_ids) {
-        const auto idx = batch.data_idx.find(t_id);
-        if (idx == batch.data_idx.cend()) { continue; }
-        batch.objects.transforms[idx->second] = TransformSystem::instance().lookup(t_id);
-      }
-    });
-    job_ids.push_back(job_id);
+  /// Renderer caches the transforms of components thus we need to fetch the ones who changed during the last frame 
+  auto& transform_system = TransformSystem::instance();
+  const std::vector<TransformChange>& journal = transform_system.get_journal();
+  /// The batches hold the transforms of two frames ago since the last swap, catch up with the previous frame first
+  /// Slots in the previous journal may have moved since, thus the transforms are looked up by entity
+  scatter_transforms(previous_journal);
+  scatter_transforms(journal);
+  previous_journal = journal;
+  transform_system.reset_dirty();
+}
+
+void Renderer::swap_snapshots() {
+  for (auto& batch : graphics_batches) {
+    batch.swap_snapshot();
   }
+}
 
-  JobSystem::instance().wait_on_all();
-}
\ No newline at end of file
+void Renderer::scatter_transforms(const std::vector<TransformChange>& changes) {
+  const auto& transform_system = TransformSystem::instance();
+  JobSystem::instance().parallel_for(0, changes.size(), 256, [&](const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const InstanceRef* ref = instance_refs.find(changes[i].entity_id);
+      if (!ref) { continue; } // Entity is not rendered
+      const Transform* transform = transform_system.find(changes[i].entity_id);
+      if (!transform) { continue; } // Transform removed since
+      graphics_batches[ref->batch].objects.transforms[ref->slot] = *transform;
+    }
+  });
+}
@@ -11,6 +11,9 @@
 
 #include "texture.h"
 #include "light.h"
+#include "glcommandqueue.h"
+#include "../nodes/transform.h"
+#include "../util/sparseset.h"
 
 #include <glm/mat4x4.hpp>
 
@@ -20,6 +23,15 @@ struct GraphicsBatch;
 struct Shader;
 struct RenderPass;
 
+/// Where the render data of an entity lives, the batch and the instance slot within it
+struct InstanceRef {
+  static const uint32_t none = UINT32_MAX;
+  uint32_t batch = none;
+  uint32_t slot  = none;
+  InstanceRef() = default;
+  InstanceRef(const uint32_t batch, const uint32_t slot): batch(batch), slot(slot) {}
+};
+
 class Renderer {
 public:
   Renderer(Renderer& render) = delete;
@@ -33,12 +45,31 @@ public:
 
   /// Main render function, renders all the graphics batches
   void render(uint32_t delta);
+
+  /// Copies the Transforms modified since the last frame into the graphics batches
+  /// Runs on the simulation thread, the batches' snapshots read by render() are left untouched
+  void update_transforms();
+
+  /// Publishes the transforms written by update_transforms to render(), call while the simulation is stopped
+  void swap_snapshots();
   
   /// Adds the data of a RenderComponent to a internal batch
+  /// Thread safe - the GL work is queued and done by execute_gl_commands on the main thread
   void add_component(const RenderComponent comp, const ID entity_id);
 
+  /// Thread safe, bulk version of add_component, queues the components as GL commands of gl_command_batch_size each
+  void add_components(std::vector<std::pair<ID, RenderComponent>>& components);
+
+  /// Runs the queued GL commands within the budget, call from the main thread while the simulation is stopped
+  void execute_gl_commands();
+
+  /// Thread safe, the instance is hidden when the queued GL commands reach it and compacted away by compact_batches
   void remove_component(ID entity_id);
 
+  /// Moves the last instances of each batch into the slots emptied since the last call and releases the memory
+  /// Must be called from the main thread while the simulation is stopped
+  void compact_batches();
+
   /// Updates all the shaders projection matrices in order to support resizing of the window
   void update_projection_matrix(const float fov);
 
@@ -54,12 +85,21 @@ public:
   float screen_height;
   std::vector<GraphicsBatch> graphics_batches;
   std::vector<PointLight> pointlights;
+  GLCommandQueue gl_commands;         // GL work pushed from any thread
+  double gl_command_budget_ms = 2.0;  // Time per frame spent on the queued GL work
+  size_t gl_command_batch_size = 64;  // Components added per GL command by add_components
 
 private:
   Renderer();
-  void add_graphics_state(GraphicsBatch& batch, const RenderComponent& comp, ID entity_id);
-  void update_transforms();
+  void add_to_batch(const RenderComponent& comp, const ID entity_id);
+  void add_graphics_state(GraphicsBatch& batch, const uint32_t batch_idx, const RenderComponent& comp, ID entity_id);
+  void remove_from_batch(const ID entity_id);
   void link_batch(GraphicsBatch& batch);
+
+  /// Copies the current Transforms of the changed entities straight into their instance slots
+  void scatter_transforms(const std::vector<TransformChange>& changes);
+  std::vector<TransformChange> previous_journal; // Transforms changed during the previous simulated frame
+  SparseSet<InstanceRef> instance_refs;          // Instance of each rendered entity
   
   /// Geometry pass related
   uint32_t gl_depth_fbo;
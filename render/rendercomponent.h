@@ -3,32 +3,26 @@
 #define MEINEKRAFT_RENDERCOMPONENT_H
 
 #include "primitives.h"
-#include "texture.h"
+#include "material.h"
+#include "../util/future.h"
 
 struct RenderComponent {
-  ShadingModel shading_model = ShadingModel::Unlit;
-  ID mesh_id; 
-  Texture diffuse_texture;
-  Texture metallic_roughness_texture; // Used by ShadingModel::PBRTextured
-  Texture ambient_occlusion_texture;
-  Texture emissive_texture;
-  Vec3f pbr_scalar_parameters;        // Used by ShadingModel::PBRScalars (r,g,b) = (unused, roughness, metallic)
+  ID mesh_id;
+  MaterialHandle material = MaterialRegistry::none;
 
-  /// Sets the mesh for the RenderComponent from the .obj file in directory_file
+  /// Sets the mesh for the RenderComponent from the .obj file in directory_file and a material with its textures
   void set_mesh(const std::string& directory, const std::string& file);
 
-  /// Sets the cube map texture to the bounded mesh
-  /// order; right, left, top, bot, back, front
-  void set_cube_map_texture(const std::vector<std::string>& faces);
+  /// Async - imports the mesh and decodes its textures on the workers, attach the component on the main thread
+  static Future<RenderComponent> load(const std::string& directory, const std::string& file);
+
+  /// Registers the material, identical materials share a handle
+  void set_material(const Material& material);
 
   /** Helper methods mainly */
   void set_mesh(MeshPrimitive primitive) {
     this->mesh_id = ID(primitive);
   }
-
-  void set_shading_model(const ShadingModel shading_model) {
-    this->shading_model = shading_model;
-  }
 };
 
 #endif // MEINEKRAFT_RENDERCOMPONENT_H
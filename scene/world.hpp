@@ -3,6 +3,7 @@
 #define MEINEKRAFT_WORLD_HPP
 
 #include "../nodes/entity.h"
+#include "../nodes/entitycommands.h"
 #include "../render/camera.h"
 #include "../util/filesystem.h"
 #include "../math/noise.h"
@@ -12,6 +13,7 @@
 #include <unordered_map>
 #include <cstdint>
 #include <iostream>
+#include <memory>
 #include <numeric>
 #include <random>
 #include <algorithm>
@@ -27,13 +29,20 @@ public:
   explicit Block(const Vec3f position, BlockType type): type(type) {
     TransformComponent transform;
     transform.position = position;
-    transform.scale = 1.0f;
+    transform.scale = Vec3f(1.0f);
     this->attach_component(transform);
+    this->attach_component(render_component(type));
+  }
+
+  /// Loads the textures of the type on first use, not thread safe
+  static RenderComponent render_component(BlockType type) {
+    Material material;
+    material.set_cube_map_texture(textures_for_block(type));
+    material.set_shading_model(ShadingModel::Unlit);
     RenderComponent render_comp;
     render_comp.set_mesh(MeshPrimitive::Cube); 
-    render_comp.set_cube_map_texture(textures_for_block(type));
-    render_comp.set_shading_model(ShadingModel::Unlit); 
-    this->attach_component(render_comp);
+    render_comp.set_material(material);
+    return render_comp;
   }
 
   static std::vector<std::string> textures_for_block(BlockType type) {
@@ -77,9 +86,18 @@ private:
   std::vector<std::vector<std::vector<Block>>> blocks;
 };
 
+/// Moves the entity back and forth along axis around center, speed in degrees of the cosine per frame
+struct Oscillator {
+  Vec3f center;
+  Vec3f axis;
+  float speed;
+};
+
 struct World {
 public:
   std::unordered_map<Vec3<int>, Chunk> chunks;
+  std::vector<std::unique_ptr<Entity>> entities; // Destroyed along with the World
+  std::vector<ID> terrain;                       // Blocks spawned through the command buffers, destroyed along with the World
   
   explicit World(): chunks{} {
     std::mt19937 engine(1337);
@@ -89,47 +107,107 @@ public:
     std::iota(X.begin(), X.end(), -10);
     for (const auto x : X) {
       Block::BlockType block_type = distr(engine) < 0.5 ? Block::BlockType::GRASS : Block::BlockType::DIRT;
-      Block* block = new Block(Vec3f(0.0f, 0.0f, 1.0f + 1.0f * x), block_type);
+      entities.emplace_back(new Block(Vec3f(0.0f, 0.0f, 1.0f + 1.0f * x), block_type));
     }
 
-    Perlin noise(1337);
+    /// Same octaves as Perlin::fbm with a zoom of 64, unrolled at compile time over tables built at compile time
+    typedef StaticFractal<StaticPerlin<1337>, 7> TerrainNoise;
     int32_t start = -50;
     int32_t end = -start;
-    for (int32_t x = start; x < end; x++) {
-      for (int32_t z = start; z < end; z++) {
-        Block::BlockType block_type = distr(engine) < 0.5 ? Block::BlockType::GRASS : Block::BlockType::DIRT;
-        Block* block = new Block(Vec3f(x, 0, z), block_type);
-
-        const int32_t y_max = 20 * noise.fbm(Vec2d(x, z), 64);
-        for (int32_t y = 1; y < y_max; y++) {
-          Vec3f position = { Vec3f(x, y, z) };
-          Block* block = new Block(position, block_type);
-        }
+    const int32_t side = end - start;
+
+    /// Terrain height and block type of each column, column i is at x = start + i % side, z = start + i / side
+    /// The noise is evaluated a few rows of the terrain at a time, eight columns at a time within a row
+    std::vector<float> noise_values(side * side);
+    std::vector<int32_t> heights(side * side);
+    std::vector<Block::BlockType> block_types(side * side);
+    for (auto& block_type : block_types) {
+      block_type = distr(engine) < 0.5 ? Block::BlockType::GRASS : Block::BlockType::DIRT;
+    }
+    JobSystem::instance().parallel_for(0, side, 4, [&](const size_t begin, const size_t finish) {
+      const size_t offset = begin * side;
+      TerrainNoise::fill_grid(Vec2f(float(start), float(start + int32_t(begin))), Vec2f(1.0f, 1.0f), side, finish - begin,
+                              noise_values.data() + offset);
+      for (size_t i = offset; i < finish * side; i++) {
+        heights[i] = int32_t(20.0f * noise_values[i]);
       }
+    });
+
+    /// The blocks of each column are recorded in parallel into the command buffers of the workers and created in
+    /// bulk at the next sync point, each column writes the IDs of its blocks into its own range of terrain
+    std::vector<size_t> offsets(heights.size() + 1, 0);
+    for (size_t i = 0; i < heights.size(); i++) {
+      offsets[i + 1] = offsets[i] + size_t(std::max(heights[i], 1));
     }
+    terrain.resize(offsets.back());
+    const RenderComponent block_renders[] = {
+      Block::render_component(Block::BlockType::GRASS), Block::render_component(Block::BlockType::DIRT)
+    };
+    JobSystem::instance().parallel_for(0, heights.size(), 64, [&](const size_t begin, const size_t finish) {
+      EntityCommandBuffer& commands = EntityCommands::local();
+      for (size_t i = begin; i < finish; i++) {
+        Vec3i voxel(start + int32_t(i) % side, 0, start + int32_t(i) / side);
+        const RenderComponent& render = block_renders[block_types[i] == Block::BlockType::GRASS ? 0 : 1];
+        for (size_t block = offsets[i]; block < offsets[i + 1]; block++, voxel.y++) {
+          const ID id = commands.create();
+          TransformComponent transform;
+          transform.position = Vec3f(voxel);
+          commands.attach(id, transform);
+          commands.attach(id, render);
+          terrain[block] = id;
+        }
+      }
+    });
+
+    /// One loop over all the oscillating entities of a chunk, the new positions are journaled in bulk
+    ActionSystem::instance().add_behaviour<Oscillator>("Oscillate",
+      [](uint64_t frame, uint64_t, size_t count, const ID* ids, const Oscillator* oscillators) {
+        /// The whole chunk at once in scratch memory, or batches on the stack if the arena is exhausted
+        const size_t stack_batch_size = 64;
+        Vec3f stack_positions[stack_batch_size];
+        Vec3f* positions = JobSystem::scratch().allocate<Vec3f>(count);
+        const size_t batch_size = positions ? count : stack_batch_size;
+        if (!positions) { positions = stack_positions; }
+        for (size_t first = 0; first < count; first += batch_size) {
+          const size_t batch_count = std::min(batch_size, count - first);
+          for (size_t i = 0; i < batch_count; i++) {
+            const Oscillator& oscillator = oscillators[first + i];
+            const float offset = std::cos(glm::radians(float(frame) * oscillator.speed));
+            positions[i] = oscillator.center + oscillator.axis * offset;
+          }
+          TransformSystem::instance().set_positions(ids + first, positions, batch_count);
+        }
+      }, Query().with<TransformComponent>());
 
     for (size_t i = 0; i < 7; i++) {
       for (size_t j = 0; j < 7; j++) {
         Entity* entity = new Entity();
+        entities.emplace_back(entity);
         TransformComponent transform;
         transform.position = Vec3f{ 2.5f * j, 2.5f + 2.5f * i, -5.0f }; 
         entity->attach_component(transform);
+        Material material;
+        material.pbr_scalar_parameters = Vec3f(0.0, 1.0 / 6.0 * i, 1.0 / 6.0 * j);
+        material.set_shading_model(ShadingModel::PhysicallyBasedScalars);
         RenderComponent render;
         render.set_mesh(MeshPrimitive::Sphere);
-        render.pbr_scalar_parameters = Vec3f(0.0, 1.0 / 6.0 * i, 1.0 / 6.0 * j);
-        render.set_shading_model(ShadingModel::PhysicallyBasedScalars);
+        render.set_material(material);
         entity->attach_component(render);
-        ActionComponent action([=](uint64_t frame, uint64_t dt) {
-          Transform t = TransformSystem::instance().lookup(entity->id); 
-          Vec3f position(transform.position.x, transform.position.y, 5.0f * std::cos(glm::radians(float(frame * 0.025f))));
-          t.matrix = t.matrix.set_translation(position); // FIXME: Add translation, avoid copy
-          TransformSystem::instance().set_transform(t, entity->id); 
-        });
-        entity->attach_component(action);
+        Oscillator oscillator;
+        oscillator.center = Vec3f(transform.position.x, transform.position.y, 0.0f);
+        oscillator.axis = Vec3f(0.0f, 0.0f, 5.0f);
+        oscillator.speed = 0.025f;
+        entity->attach_component(oscillator);
       }
     }
   }
   
+  ~World() {
+    for (const ID id : terrain) {
+      EntitySystem::instance().destroy_entity(id);
+    }
+  }
+
   /// World position is measured in Chunk lengths
   Vec3f world_position(const Vec3f& position) const {
     Vec3f result{};
@@ -139,6 +217,11 @@ public:
     return result;
   }
 
+  /// Chunk holding the voxel at the position and the voxel within it, in integers all the way
+  ChunkCoordinate chunk_coordinate(const Vec3f& position) const {
+    return split_chunk(voxel_coordinate(position), Chunk::dimension);
+  }
+
   // TODO: Update all Entities 
   void tick() {
 
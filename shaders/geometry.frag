@@ -2,9 +2,7 @@
 in vec3 fNormal;
 in vec3 fPosition;
 in vec2 fTexcoord;
-flat in int fDiffuse_layer_idx;
-flat in int fShading_model_id;
-flat in vec3 fPbr_scalar_parameters;
+flat in uint fMaterial_idx;
 
 layout(location = 0) out vec3 gNormal;
 layout(location = 1) out vec3 gPosition;
@@ -19,33 +17,48 @@ uniform sampler2DArray diffuse;
 #elif defined(DIFFUSE_CUBEMAP)
 uniform samplerCubeArray diffuse;
 #endif
-uniform sampler2D pbr_parameters;
-uniform sampler2D ambient_occlusion;
-uniform sampler2D emissive;
+uniform sampler2DArray pbr_parameters;
+uniform sampler2DArray ambient_occlusion;
+uniform sampler2DArray emissive;
+
+/// MaterialParameters of the MaterialRegistry
+struct Material {
+    vec3 pbr_scalar_parameters;
+    int shading_model;
+    int diffuse_layer;             // Layers in the texture arrays, -1 if the material has no such texture
+    int metallic_roughness_layer;
+    int ambient_occlusion_layer;
+    int emissive_layer;
+};
+
+layout(std430) buffer MaterialBlock {
+    Material materials[];
+};
 
 void main() {
+    const Material material = materials[fMaterial_idx];
     gNormal = normalize(fNormal);
     gPosition = fPosition;
     
     #ifdef DIFFUSE_2D
-    gDiffuse.rgb = texture(diffuse, vec3(fTexcoord, fDiffuse_layer_idx)).rgb; 
+    gDiffuse.rgb = texture(diffuse, vec3(fTexcoord, material.diffuse_layer)).rgb; 
     #elif defined(DIFFUSE_CUBEMAP)
-    gDiffuse.rgb = texture(diffuse, vec4(normalize(fPosition), fDiffuse_layer_idx)).rgb;
+    gDiffuse.rgb = texture(diffuse, vec4(normalize(fPosition), material.diffuse_layer)).rgb;
     #endif
     gDiffuse.a = 1.0; // Fetch from texture?
 
-    switch (fShading_model_id) {
+    switch (material.shading_model) {
         case 2: // Physically based rendering with textures 
-        gPBRParameters = texture(pbr_parameters, fTexcoord).rgb; // Usually (unused, metallic, roughness)
-        gEmissive = texture(emissive, fTexcoord).rgb;
+        gPBRParameters = texture(pbr_parameters, vec3(fTexcoord, material.metallic_roughness_layer)).rgb; // Usually (unused, metallic, roughness)
+        gEmissive = material.emissive_layer < 0 ? vec3(0.0) : texture(emissive, vec3(fTexcoord, material.emissive_layer)).rgb;
         break;
         case 3: // Physically based rendering with scalar
         gDiffuse.rgb = vec3(1.0, 0.0, 0.0); // FIXME: Temporary color for unlit objects
-        gPBRParameters = fPbr_scalar_parameters;
+        gPBRParameters = material.pbr_scalar_parameters;
         gEmissive = vec3(0.0);
         break;
     }
 
-    gAmbientOcclusion = texture(ambient_occlusion, fTexcoord).rgb;
-    gShadingModelID = fShading_model_id;
+    gAmbientOcclusion = material.ambient_occlusion_layer < 0 ? vec3(1.0) : texture(ambient_occlusion, vec3(fTexcoord, material.ambient_occlusion_layer)).rgb;
+    gShadingModelID = material.shading_model;
 }
\ No newline at end of file
@@ -6,16 +6,12 @@ in mat4 model;
 in vec3 position;
 in vec3 normal;
 in vec2 texcoord;
-in int diffuse_layer_idx;
-in int shading_model_id;
-in vec3 pbr_scalar_parameters;
+in uint material_idx;
 
 out vec3 fNormal;
 out vec3 fPosition;
 out vec2 fTexcoord;
-flat out int fDiffuse_layer_idx;
-flat out int fShading_model_id;
-flat out vec3 fPbr_scalar_parameters;
+flat out uint fMaterial_idx;
 
 void main() {
     gl_Position = projection * camera_view * model * vec4(position, 1.0);
@@ -26,7 +22,5 @@ void main() {
     fPosition = vec3(vec4(position, 1.0));
     #endif
     fTexcoord = texcoord;
-    fDiffuse_layer_idx = diffuse_layer_idx;
-    fShading_model_id = shading_model_id;
-    fPbr_scalar_parameters = pbr_scalar_parameters;
+    fMaterial_idx = material_idx;
 }
\ No newline at end of file
@@ -0,0 +1,207 @@
+#pragma once
+#ifndef MEINEKRAFT_FUTURE_H
+#define MEINEKRAFT_FUTURE_H
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "jobsystem.h"
+
+/// Thread a stage of an asynchronous pipeline runs on
+enum class Executor {
+  Worker,    // An idle JobSystem worker, for file IO, decoding and other long running CPU work
+  MainThread // The main (GL) thread, for anything touching GL or the engine systems
+};
+
+/// Tasks posted from any thread to be run by the main loop on the main thread
+struct MainThreadQueue {
+  /// Singleton instance
+  static MainThreadQueue& instance() {
+    static MainThreadQueue instance;
+    return instance;
+  }
+
+  void post(std::function<void()> task) {
+    std::lock_guard<std::mutex> lk(mutex);
+    tasks.push_back(std::move(task));
+  }
+
+  /// Runs the tasks posted so far, tasks posted meanwhile run on the next call
+  /// Must be called from the main thread while the simulation is stopped
+  size_t execute_all() {
+    {
+      std::lock_guard<std::mutex> lk(mutex);
+      running.swap(tasks);
+    }
+    const size_t num_tasks = running.size();
+    for (auto& task : running) {
+      task();
+    }
+    running.clear();
+    return num_tasks;
+  }
+
+private:
+  std::mutex mutex;
+  std::vector<std::function<void()>> tasks;
+  std::vector<std::function<void()>> running; // Only touched by the main thread
+};
+
+/// Value of a Future<void>
+struct Done {};
+
+template<typename T>
+struct FutureValue { using type = T; };
+
+template<>
+struct FutureValue<void> { using type = Done; };
+
+/// Shared state of a Future, completed exactly once by the stage computing it
+struct FutureStateBase {
+  Executor executor = Executor::Worker;
+  std::function<void()> task; // Computes the value and completes the state, set for all but the first stage
+
+  /// Runs the continuation once the state is complete, right away if it already is
+  void on_ready(std::function<void()> continuation) {
+    std::unique_lock<std::mutex> lk(mutex);
+    if (!ready) {
+      continuations.push_back(std::move(continuation));
+      return;
+    }
+    lk.unlock();
+    continuation();
+  }
+
+  void complete() {
+    std::vector<std::function<void()>> ready_continuations;
+    {
+      std::lock_guard<std::mutex> lk(mutex);
+      ready = true;
+      ready_continuations.swap(continuations);
+    }
+    cv.notify_all();
+    for (auto& continuation : ready_continuations) {
+      continuation();
+    }
+  }
+
+  bool is_ready() {
+    std::lock_guard<std::mutex> lk(mutex);
+    return ready;
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lk(mutex);
+    cv.wait(lk, [&]{ return ready; });
+  }
+
+  /// Queues the task of the state on its executor
+  static void schedule(const std::shared_ptr<FutureStateBase>& state) {
+    if (state->executor == Executor::MainThread) {
+      MainThreadQueue::instance().post([state]() { state->task(); });
+    } else {
+      JobSystem::instance().execute_background([state]() { state->task(); });
+    }
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool ready = false;
+  std::vector<std::function<void()>> continuations;
+};
+
+template<typename T>
+struct FutureState: FutureStateBase {
+  typename FutureValue<T>::type value;
+};
+
+/// Calls a continuation with the value of the previous stage, continuations of Future<void> take no arguments
+template<typename T>
+struct FutureCall {
+  template<typename F>
+  static auto call(F& func, FutureState<T>& state) -> decltype(func(state.value)) { return func(state.value); }
+};
+
+template<>
+struct FutureCall<void> {
+  template<typename F>
+  static auto call(F& func, FutureState<void>&) -> decltype(func()) { return func(); }
+};
+
+/// Stores the result of a stage in its state
+template<typename R>
+struct FutureStore {
+  template<typename Thunk>
+  static void store(FutureState<R>& state, Thunk& thunk) { state.value = thunk(); }
+};
+
+template<>
+struct FutureStore<void> {
+  template<typename Thunk>
+  static void store(FutureState<void>&, Thunk& thunk) { thunk(); }
+};
+
+template<typename T, typename F>
+using FutureResult = decltype(FutureCall<T>::call(std::declval<F&>(), std::declval<FutureState<T>&>()));
+
+/// Result of an asynchronous pipeline stage
+/// Stages are chained with then(), each runs on its executor as soon as the previous one completes, e.g
+///   run_async([=]() { return decode(file); }).then_on_main([](Image& image) { upload(image); });
+/// The value is passed to the continuation by reference, a continuation may move from it when it is the only one.
+template<typename T>
+struct Future {
+  using Value = typename FutureValue<T>::type;
+
+  Future() = default;
+  explicit Future(std::shared_ptr<FutureState<T>> state): state(std::move(state)) {}
+
+  bool valid() const { return state != nullptr; }
+  bool ready() const { return state->is_ready(); }
+
+  /// Blocking - waits for the value, must not be called from within a job or for a pipeline with main thread stages
+  /// from the main thread, both would wait on themselves
+  Value& get() const {
+    state->wait();
+    return state->value;
+  }
+
+  /// Async - runs func(value) on the executor once the value is ready
+  template<typename F>
+  Future<FutureResult<T, F>> then(F func, const Executor executor = Executor::Worker) const {
+    using R = FutureResult<T, F>;
+    std::shared_ptr<FutureState<R>> next = std::make_shared<FutureState<R>>();
+    next->executor = executor;
+    FutureState<R>* next_state = next.get(); // Raw pointer since the state must not own itself
+    std::shared_ptr<FutureState<T>> previous = state;
+    next->task = [previous, next_state, func]() mutable {
+      auto thunk = [&]() { return FutureCall<T>::call(func, *previous); };
+      FutureStore<R>::store(*next_state, thunk);
+      next_state->complete();
+    };
+    state->on_ready([next]() { FutureStateBase::schedule(next); });
+    return Future<R>(next);
+  }
+
+  /// Async - runs func(value) on the main thread once the value is ready
+  template<typename F>
+  Future<FutureResult<T, F>> then_on_main(F func) const {
+    return then(std::move(func), Executor::MainThread);
+  }
+
+  std::shared_ptr<FutureState<T>> state;
+};
+
+/// Async - starts a pipeline by running func() on the executor
+template<typename F>
+Future<FutureResult<void, F>> run_async(F func, const Executor executor = Executor::Worker) {
+  std::shared_ptr<FutureState<void>> start = std::make_shared<FutureState<void>>();
+  start->complete();
+  return Future<void>(start).then(std::move(func), executor);
+}
+
+#endif // MEINEKRAFT_FUTURE_H
@@ -0,0 +1,105 @@
+#pragma once
+#ifndef MEINEKRAFT_INLINEFUNCTION_H
+#define MEINEKRAFT_INLINEFUNCTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template<typename Signature, size_t Capacity = 64>
+class InlineFunction;
+
+/// Drop-in replacement for std::function that stores the callable inside itself and never allocates
+/// Callables larger than Capacity bytes are rejected at compile time, capture references or pointers instead
+template<typename R, typename... Args, size_t Capacity>
+class InlineFunction<R(Args...), Capacity> {
+  enum class Operation: uint8_t { Copy, Move, Destroy };
+
+  typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type storage;
+  R (*invoker)(void*, Args...);
+  void (*manager)(Operation, void* dst, void* src);
+
+  template<typename F>
+  static R invoke(void* callable, Args... args) {
+    return (*static_cast<F*>(callable))(std::forward<Args>(args)...);
+  }
+
+  template<typename F>
+  static void manage(Operation operation, void* dst, void* src) {
+    switch (operation) {
+    case Operation::Copy:
+      new (dst) F(*static_cast<const F*>(src));
+      break;
+    case Operation::Move:
+      new (dst) F(std::move(*static_cast<F*>(src)));
+      break;
+    case Operation::Destroy:
+      static_cast<F*>(dst)->~F();
+      break;
+    }
+  }
+
+public:
+  InlineFunction(): invoker(nullptr), manager(nullptr) {}
+  InlineFunction(std::nullptr_t): invoker(nullptr), manager(nullptr) {}
+
+  template<typename F, typename Callable = typename std::decay<F>::type,
+           typename = typename std::enable_if<!std::is_same<Callable, InlineFunction>::value>::type>
+  InlineFunction(F&& func): invoker(&invoke<Callable>), manager(&manage<Callable>) {
+    static_assert(sizeof(Callable) <= Capacity, "Callable does not fit in the InlineFunction, capture less or by reference");
+    static_assert(alignof(Callable) <= alignof(std::max_align_t), "Callable is over-aligned for the InlineFunction");
+    new (&storage) Callable(std::forward<F>(func));
+  }
+
+  InlineFunction(const InlineFunction& other): invoker(other.invoker), manager(other.manager) {
+    if (manager) { manager(Operation::Copy, &storage, const_cast<void*>(static_cast<const void*>(&other.storage))); }
+  }
+
+  InlineFunction(InlineFunction&& other): invoker(other.invoker), manager(other.manager) {
+    if (manager) { manager(Operation::Move, &storage, &other.storage); }
+  }
+
+  ~InlineFunction() { reset(); }
+
+  InlineFunction& operator=(const InlineFunction& other) {
+    if (this != &other) {
+      reset();
+      invoker = other.invoker;
+      manager = other.manager;
+      if (manager) { manager(Operation::Copy, &storage, const_cast<void*>(static_cast<const void*>(&other.storage))); }
+    }
+    return *this;
+  }
+
+  InlineFunction& operator=(InlineFunction&& other) {
+    if (this != &other) {
+      reset();
+      invoker = other.invoker;
+      manager = other.manager;
+      if (manager) { manager(Operation::Move, &storage, &other.storage); }
+    }
+    return *this;
+  }
+
+  InlineFunction& operator=(std::nullptr_t) {
+    reset();
+    return *this;
+  }
+
+  /// Destroys the stored callable, if any
+  void reset() {
+    if (manager) { manager(Operation::Destroy, &storage, nullptr); }
+    invoker = nullptr;
+    manager = nullptr;
+  }
+
+  explicit operator bool() const { return invoker != nullptr; }
+
+  R operator()(Args... args) const {
+    return invoker(const_cast<void*>(static_cast<const void*>(&storage)), std::forward<Args>(args)...);
+  }
+};
+
+#endif // MEINEKRAFT_INLINEFUNCTION_H
@@ -0,0 +1,314 @@
+#include "jobsystem.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "logging.h"
+
+thread_local int32_t JobSystem::worker_idx = -1;
+
+/// Logical CPUs ordered for worker placement
+/// SMT aware ordering puts the first hardware thread of every physical core before any of the SMT siblings
+struct CpuTopology {
+  std::vector<int32_t> cpus;
+  std::vector<int32_t> cores; // Lowest logical CPU sharing a physical core with the CPU at the same index
+
+  explicit CpuTopology(const bool smt_aware) {
+    const int32_t num_cpus = std::thread::hardware_concurrency() == 0 ? 4 : int32_t(std::thread::hardware_concurrency());
+    std::vector<std::pair<int32_t, int32_t>> cpu_cores;
+    for (int32_t cpu = 0; cpu < num_cpus; cpu++) {
+      cpu_cores.emplace_back(cpu, physical_core(cpu));
+    }
+    if (smt_aware) {
+      std::stable_sort(cpu_cores.begin(), cpu_cores.end(), [](const std::pair<int32_t, int32_t>& a, const std::pair<int32_t, int32_t>& b) {
+        return (a.first != a.second) < (b.first != b.second);
+      });
+    }
+    for (const auto& cpu_core : cpu_cores) {
+      cpus.push_back(cpu_core.first);
+      cores.push_back(cpu_core.second);
+    }
+  }
+
+  /// First logical CPU listed in the SMT siblings of the CPU (itself when unknown)
+  static int32_t physical_core(const int32_t cpu) {
+#if defined(__linux__)
+    const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list";
+    std::ifstream file(path);
+    int32_t sibling = cpu;
+    if (file >> sibling) { return sibling; }
+#endif
+    return cpu;
+  }
+};
+
+static bool pin_thread(std::thread::native_handle_type handle, const int32_t cpu) {
+#if defined(__linux__)
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  return pthread_setaffinity_np(handle, sizeof(cpu_set_t), &cpu_set) == 0;
+#elif defined(_WIN32)
+  return SetThreadAffinityMask(handle, DWORD_PTR(1) << cpu) != 0;
+#else
+  return false;
+#endif
+}
+
+/// Affinity the process started with, read before any thread is pinned
+#if defined(__linux__)
+static const cpu_set_t& process_affinity() {
+  static const cpu_set_t cpu_set = []() {
+    cpu_set_t initial;
+    CPU_ZERO(&initial);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &initial) != 0) {
+      for (int32_t cpu = 0; cpu < CPU_SETSIZE; cpu++) { CPU_SET(cpu, &initial); }
+    }
+    return initial;
+  }();
+  return cpu_set;
+}
+#endif
+
+/// Lets the thread run on any CPU of the process again
+static bool unpin_thread(std::thread::native_handle_type handle) {
+#if defined(__linux__)
+  return pthread_setaffinity_np(handle, sizeof(cpu_set_t), &process_affinity()) == 0;
+#elif defined(_WIN32)
+  DWORD_PTR process_mask = 0, system_mask = 0;
+  return GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask) &&
+         SetThreadAffinityMask(handle, process_mask) != 0;
+#else
+  return false;
+#endif
+}
+
+static std::thread::native_handle_type current_thread_handle() {
+#if defined(_WIN32)
+  return GetCurrentThread();
+#else
+  return pthread_self();
+#endif
+}
+
+JobSystem::JobSystem(): workers{}, submission_queue{}, background_queue{}, queued_jobs(0), queued_background_jobs(0),
+                        pending_jobs(0), sleeping_workers(0), waiting_threads(0), exiting(false) {
+  start_workers();
+}
+
+JobSystem::~JobSystem() {
+  stop_workers();
+}
+
+void JobSystem::configure(const JobSystemConfig& new_config) {
+  wait_on_all();
+  stop_workers();
+  config = new_config;
+  start_workers();
+}
+
+void JobSystem::start_workers() {
+#if defined(__linux__)
+  process_affinity();
+#endif
+  const CpuTopology topology(config.smt_aware);
+
+  /// The main thread gets the first core, with all of its SMT siblings when SMT aware
+  std::vector<int32_t> worker_cpus;
+  for (size_t i = 0; i < topology.cpus.size(); i++) {
+    const bool reserved = config.reserve_main_thread_core &&
+                          (topology.cpus[i] == topology.cpus[0] || (config.smt_aware && topology.cores[i] == topology.cores[0]));
+    if (!reserved) { worker_cpus.push_back(topology.cpus[i]); }
+  }
+  if (worker_cpus.empty()) { worker_cpus.push_back(topology.cpus[0]); }
+
+  const size_t num_threads = config.num_workers == 0 ? worker_cpus.size() : config.num_workers;
+  Log::info("JobSystem using " + std::to_string(num_threads) + " workers");
+
+  /// A main thread pinned by an earlier configuration gets the process affinity back when it is no longer reserved
+  const int32_t pinned_cpu = main_thread_cpu;
+  main_thread_cpu = -1;
+  if (config.pin_threads && config.reserve_main_thread_core && pin_thread(current_thread_handle(), topology.cpus[0])) {
+    main_thread_cpu = topology.cpus[0];
+  } else if (pinned_cpu >= 0 && !unpin_thread(current_thread_handle())) {
+    main_thread_cpu = pinned_cpu;
+  }
+
+  // All queues must exist before any worker starts stealing
+  for (size_t i = 0; i < num_threads; i++) {
+    workers.emplace_back(new Worker());
+  }
+  for (size_t i = 0; i < num_threads; i++) {
+    workers[i]->thread = std::thread(&JobSystem::worker_loop, this, i);
+    const int32_t cpu = worker_cpus[i % worker_cpus.size()];
+    if (config.pin_threads && pin_thread(workers[i]->thread.native_handle(), cpu)) {
+      workers[i]->cpu = cpu;
+    }
+  }
+  sampled_at = std::chrono::steady_clock::now();
+}
+
+void JobSystem::stop_workers() {
+  {
+    std::lock_guard<std::mutex> lk(park_mutex);
+    exiting = true;
+  }
+  park_cv.notify_all();
+  for (auto& worker : workers) {
+    worker->thread.join();
+  }
+  workers.clear();
+  exiting = false;
+}
+
+void JobSystem::sample_utilisation(std::vector<float>& utilisation) {
+  const auto now = std::chrono::steady_clock::now();
+  const double elapsed_ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(now - sampled_at).count());
+  sampled_at = now;
+  utilisation.resize(workers.size());
+  for (size_t i = 0; i < workers.size(); i++) {
+    const uint64_t busy_ns = workers[i]->busy_ns.load();
+    const double busy = elapsed_ns > 0.0 ? double(busy_ns - workers[i]->sampled_busy_ns) / elapsed_ns : 0.0;
+    utilisation[i] = float(busy > 1.0 ? 1.0 : busy);
+    workers[i]->sampled_busy_ns = busy_ns;
+  }
+}
+
+void JobSystem::execute(JobFunction func, JobCounter* counter) {
+  if (counter) { counter->value++; }
+  pending_jobs++;
+  queued_jobs++;
+  if (worker_idx >= 0) {
+    workers[worker_idx]->queue.push(Job{std::move(func), counter});
+  } else {
+    submission_queue.push(Job{std::move(func), counter});
+  }
+
+  // Only touch the parking lot when someone is actually sleeping in it
+  if (sleeping_workers.load() > 0) {
+    std::lock_guard<std::mutex> lk(park_mutex);
+    park_cv.notify_one();
+  }
+  notify_waiting_threads();
+}
+
+void JobSystem::execute_background(JobFunction func) {
+  pending_jobs++;
+  queued_background_jobs++;
+  background_queue.push(Job{std::move(func), nullptr});
+
+  // Threads in wait() do not take background jobs, only a parked worker needs to know
+  if (sleeping_workers.load() > 0) {
+    std::lock_guard<std::mutex> lk(park_mutex);
+    park_cv.notify_one();
+  }
+}
+
+void JobSystem::wait(JobCounter& counter) {
+  Job job;
+  while (!counter.done()) {
+    if (find_job(job)) {
+      run(job);
+      continue;
+    }
+
+    // Nothing to help with, sleep until either the counter is done or more work shows up
+    std::unique_lock<std::mutex> lk(wait_mutex);
+    waiting_threads++;
+    wait_cv.wait(lk, [&]{ return counter.done() || queued_jobs.load() > 0; });
+    waiting_threads--;
+  }
+}
+
+void JobSystem::wait_on_all() {
+  std::unique_lock<std::mutex> lk(idle_mutex);
+  idle_cv.wait(lk, [&]{ return pending_jobs.load() == 0; });
+}
+
+bool JobSystem::find_job(Job& job) {
+  if (queued_jobs.load() == 0) { return false; }
+
+  const size_t num_workers = workers.size();
+  const size_t start = worker_idx >= 0 ? size_t(worker_idx) : 0;
+  if (worker_idx >= 0 && workers[start]->queue.pop_back(job)) {
+    queued_jobs--;
+    return true;
+  }
+
+  if (submission_queue.pop_front(job)) {
+    queued_jobs--;
+    return true;
+  }
+
+  for (size_t i = 1; i <= num_workers; i++) {
+    const size_t victim = (start + i) % num_workers;
+    if (int32_t(victim) == worker_idx) { continue; }
+    if (workers[victim]->queue.pop_front(job)) {
+      queued_jobs--;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool JobSystem::find_background_job(Job& job) {
+  if (queued_background_jobs.load() == 0) { return false; }
+  if (background_queue.pop_front(job)) {
+    queued_background_jobs--;
+    return true;
+  }
+  return false;
+}
+
+void JobSystem::notify_waiting_threads() {
+  if (waiting_threads.load() > 0) {
+    std::lock_guard<std::mutex> lk(wait_mutex);
+    wait_cv.notify_all();
+  }
+}
+
+void JobSystem::run(Job& job) {
+  ScratchArena& arena = scratch();
+  const size_t mark = arena.mark();
+  job.workload();
+  job.workload = nullptr;
+  arena.rewind(mark);
+  if (job.counter && job.counter->value.fetch_sub(1) == 1) {
+    notify_waiting_threads();
+  }
+  job.counter = nullptr;
+  if (pending_jobs.fetch_sub(1) == 1) {
+    std::lock_guard<std::mutex> lk(idle_mutex);
+    idle_cv.notify_all();
+  }
+}
+
+void JobSystem::worker_loop(const size_t idx) {
+  worker_idx = int32_t(idx);
+  Job job;
+  while (true) {
+    if (find_job(job) || find_background_job(job)) {
+      const auto start = std::chrono::steady_clock::now();
+      run(job);
+      const auto busy = std::chrono::steady_clock::now() - start;
+      workers[idx]->busy_ns += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count());
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lk(park_mutex);
+    sleeping_workers++;
+    park_cv.wait(lk, [&]{ return queued_jobs.load() > 0 || queued_background_jobs.load() > 0 || exiting.load(); });
+    sleeping_workers--;
+    if (exiting.load() && queued_jobs.load() == 0 && queued_background_jobs.load() == 0) { return; }
+  }
+}
@@ -0,0 +1,258 @@
+#pragma once
+#ifndef MEINEKRAFT_JOBSYSTEM_H
+#define MEINEKRAFT_JOBSYSTEM_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "inlinefunction.h"
+
+/// Number of unfinished jobs associated with it, decremented atomically as each job finishes
+struct JobCounter {
+  std::atomic<uint32_t> value;
+  JobCounter(): value(0) {}
+  JobCounter(const JobCounter&) = delete;
+
+  bool done() const { return value.load() == 0; }
+};
+
+/// Work of a Job, kept inline in the Job so that dispatching does not allocate
+using JobFunction = InlineFunction<void(), 64>;
+
+/// Unit of work executed by the JobSystem
+struct Job {
+  JobFunction workload;
+  JobCounter* counter; // Optional, decremented when the workload has run
+
+  Job(): workload{}, counter(nullptr) {}
+  Job(JobFunction&& workload, JobCounter* counter): workload(std::move(workload)), counter(counter) {}
+};
+
+/// Linear allocator for temporary memory of a Job, everything allocated during a Job is released when it finishes
+/// Each thread has its own arena so allocating from it is free of contention and of calls to the heap
+struct ScratchArena {
+  explicit ScratchArena(const size_t capacity): buffer(new uint8_t[capacity]), capacity(capacity), offset(0) {}
+
+  /// Returns nullptr when the arena is exhausted
+  void* allocate(const size_t size, const size_t alignment = alignof(std::max_align_t)) {
+    const size_t start = (offset + alignment - 1) & ~(alignment - 1);
+    if (start + size > capacity) { return nullptr; }
+    offset = start + size;
+    return buffer.get() + start;
+  }
+
+  template<typename T>
+  T* allocate(const size_t count) {
+    return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+  }
+
+  size_t mark() const { return offset; }
+  void rewind(const size_t mark) { offset = mark; }
+
+private:
+  std::unique_ptr<uint8_t[]> buffer;
+  const size_t capacity;
+  size_t offset;
+};
+
+/// Unbounded double ended queue of Jobs backed by a ring buffer that only ever grows
+/// The owning worker pushes and pops at the back (LIFO), thieves take from the front (FIFO)
+struct JobQueue {
+  JobQueue(): ring(64), head(0), count(0) {}
+
+  void push(Job&& job) {
+    std::lock_guard<std::mutex> lk(mut);
+    if (count == ring.size()) { grow(); }
+    ring[(head + count) % ring.size()] = std::move(job);
+    count++;
+  }
+
+  /// Owner end
+  bool pop_back(Job& job) {
+    std::lock_guard<std::mutex> lk(mut);
+    if (count == 0) { return false; }
+    count--;
+    job = std::move(ring[(head + count) % ring.size()]);
+    return true;
+  }
+
+  /// Thief end
+  bool pop_front(Job& job) {
+    std::lock_guard<std::mutex> lk(mut);
+    if (count == 0) { return false; }
+    job = std::move(ring[head]);
+    head = (head + 1) % ring.size();
+    count--;
+    return true;
+  }
+
+private:
+  std::mutex mut;
+  std::vector<Job> ring;
+  size_t head;  // Index of the front element
+  size_t count; // Number of Jobs in the ring
+
+  /// Doubles the capacity while keeping the order of the Jobs
+  void grow() {
+    std::vector<Job> new_ring(ring.size() * 2);
+    for (size_t i = 0; i < count; i++) {
+      new_ring[i] = std::move(ring[(head + i) % ring.size()]);
+    }
+    ring.swap(new_ring);
+    head = 0;
+  }
+};
+
+/// Thread layout of the JobSystem
+struct JobSystemConfig {
+  size_t num_workers = 0;               // 0 uses one worker per hardware thread that is not reserved
+  bool reserve_main_thread_core = true; // Keeps a core free for the main (GL) thread
+  bool pin_threads = false;             // Pins each worker, and the main thread, to its own logical CPU
+  bool smt_aware = true;                // Spreads workers over physical cores before using their SMT siblings
+};
+
+/// Work stealing job scheduler
+/// Each worker owns a JobQueue, Jobs submitted from a worker go into its own queue and
+/// Jobs submitted from any other thread go into the shared submission queue.
+/// Idle workers steal from each other and park on a condition variable when there is nothing to do.
+/// Long running background Jobs (asset loads) have a queue of their own which only idle workers take from, a thread
+/// helping out in wait() never picks one up in the middle of the work it is waiting on.
+struct JobSystem {
+  /// Singleton instance
+  static JobSystem& instance() {
+    static JobSystem instance;
+    return instance;
+  }
+
+  JobSystem();
+  ~JobSystem();
+
+  /// Blocking - finishes all jobs and restarts the workers with the new layout
+  /// Must be called from the main thread while no other thread submits jobs
+  void configure(const JobSystemConfig& config);
+  const JobSystemConfig& get_config() const { return config; }
+
+  /// Async - queues the function for execution on one of the workers
+  /// The counter (if any) is incremented now and decremented once the function has run
+  void execute(JobFunction func, JobCounter* counter = nullptr);
+
+  /// Async - queues a long running function (file IO, decoding) for execution on an otherwise idle worker
+  void execute_background(JobFunction func);
+
+  /// Blocking - runs other queued jobs on the calling thread until the counter reaches zero, background jobs excluded
+  /// Safe to call from within a job
+  void wait(JobCounter& counter);
+
+  /// Blocking - waits until all of the queued and running jobs are done
+  /// Must not be called from within a job, prefer wait(counter) which only waits on the relevant jobs
+  void wait_on_all();
+
+  /// Blocking - calls func(sub_begin, sub_end) on disjoint sub ranges covering [begin, end) in parallel
+  /// The range is split in halves down to the grain size, but only while the queues are too short to keep
+  /// every worker busy, the rest is consumed grain by grain on the calling thread (lazy binary splitting)
+  template<typename Func>
+  void parallel_for(const size_t begin, const size_t end, const size_t grain, const Func& func) {
+    if (begin >= end) { return; }
+    JobCounter counter;
+    parallel_for_range(begin, end, grain == 0 ? 1 : grain, func, counter);
+    wait(counter);
+  }
+
+  size_t num_workers() const { return workers.size(); }
+
+  /// Logical CPU the worker is pinned to, -1 if it is not pinned
+  int32_t worker_cpu(const size_t idx) const { return workers[idx]->cpu; }
+
+  /// Logical CPU the main thread is pinned to, -1 if it is not pinned
+  int32_t get_main_thread_cpu() const { return main_thread_cpu; }
+
+  /// Fraction of the time since the previous call that each worker spent running jobs
+  void sample_utilisation(std::vector<float>& utilisation);
+
+  /// Scratch memory of the calling thread, allocations made within a Job are released when the Job finishes
+  static ScratchArena& scratch() {
+    static thread_local ScratchArena arena(scratch_arena_size);
+    return arena;
+  }
+
+  static const size_t scratch_arena_size = 1 << 20;
+
+private:
+  struct Worker {
+    JobQueue queue;
+    std::thread thread;
+    int32_t cpu = -1;
+    std::atomic<uint64_t> busy_ns{0};   // Total time spent running jobs
+    uint64_t sampled_busy_ns = 0;        // busy_ns at the previous utilisation sample
+  };
+
+  JobSystemConfig config;
+  int32_t main_thread_cpu = -1;
+  std::chrono::steady_clock::time_point sampled_at;
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  JobQueue submission_queue;           // Jobs submitted from non-worker threads
+  JobQueue background_queue;           // Jobs submitted with execute_background
+
+  std::atomic<size_t> queued_jobs;     // Jobs sitting in any of the queues but the background queue
+  std::atomic<size_t> queued_background_jobs;
+  std::atomic<size_t> pending_jobs;    // Jobs queued or currently running, background jobs included
+  std::atomic<size_t> sleeping_workers;
+  std::atomic<size_t> waiting_threads; // Threads blocked in wait(counter) with nothing to help with
+  std::atomic<bool> exiting;
+
+  std::mutex park_mutex;               // Guards parking of idle workers
+  std::condition_variable park_cv;
+  std::mutex idle_mutex;               // Guards waiting for all jobs to finish
+  std::condition_variable idle_cv;
+  std::mutex wait_mutex;               // Guards waiting on JobCounters
+  std::condition_variable wait_cv;
+
+  /// Index of the worker owning the current thread, -1 for threads outside of the JobSystem
+  static thread_local int32_t worker_idx;
+
+  void start_workers();
+  void stop_workers();
+  void worker_loop(const size_t idx);
+
+  /// Takes a Job from the own queue, the submission queue or steals one from another worker
+  bool find_job(Job& job);
+
+  /// Takes a Job from the background queue, only for idle workers
+  bool find_background_job(Job& job);
+
+  void run(Job& job);
+
+  /// Wakes the threads blocked in wait(counter) if there are any
+  void notify_waiting_threads();
+
+  /// Splitting is worthwhile when there are fewer queued jobs than workers to steal them
+  bool should_split() const { return queued_jobs.load() < workers.size(); }
+
+  template<typename Func>
+  void parallel_for_range(size_t begin, size_t end, const size_t grain, const Func& func, JobCounter& counter) {
+    while (begin < end) {
+      while (end - begin > grain && should_split()) {
+        const size_t mid = begin + (end - begin) / 2;
+        const size_t upper_end = end;
+        execute([=, &func, &counter]() { parallel_for_range(mid, upper_end, grain, func, counter); }, &counter);
+        end = mid;
+      }
+      // Each chunk gets the scratch memory to itself, just like a Job
+      ScratchArena& arena = scratch();
+      const size_t mark = arena.mark();
+      const size_t chunk_end = end - begin > grain ? begin + grain : end;
+      func(begin, chunk_end);
+      arena.rewind(mark);
+      begin = chunk_end;
+    }
+  }
+};
+
+#endif // MEINEKRAFT_JOBSYSTEM_H
@@ -0,0 +1,63 @@
+#include "simulationthread.h"
+
+#include <chrono>
+
+SimulationThread::SimulationThread(const std::function<void(uint64_t, int64_t)>& simulate): simulate(simulate) {
+  thread = std::thread(&SimulationThread::loop, this);
+}
+
+SimulationThread::~SimulationThread() {
+  stop();
+}
+
+void SimulationThread::hand_off(const int64_t delta, const InlineFunction<void()>& sync) {
+  using namespace std::chrono;
+  const auto start = high_resolution_clock::now();
+  std::unique_lock<std::mutex> lk(mutex);
+  cv.wait(lk, [&]{ return simulated_frames == requested_frames; });
+  hand_off_wait_ms = duration<double, std::milli>(high_resolution_clock::now() - start).count();
+
+  if (sync) { sync(); }
+
+  frame_delta = delta;
+  requested_frames++;
+  lk.unlock();
+  cv.notify_all();
+}
+
+void SimulationThread::stop() {
+  if (!thread.joinable()) { return; }
+  {
+    std::unique_lock<std::mutex> lk(mutex);
+    cv.wait(lk, [&]{ return simulated_frames == requested_frames; });
+    exiting = true;
+  }
+  cv.notify_all();
+  thread.join();
+}
+
+void SimulationThread::loop() {
+  using namespace std::chrono;
+  while (true) {
+    int64_t delta = 0;
+    uint64_t frame = 0;
+    {
+      std::unique_lock<std::mutex> lk(mutex);
+      cv.wait(lk, [&]{ return exiting || simulated_frames < requested_frames; });
+      if (exiting) { return; }
+      delta = frame_delta;
+      frame = simulated_frames + 1;
+    }
+
+    const auto start = high_resolution_clock::now();
+    simulate(frame, delta);
+    const double elapsed_ms = duration<double, std::milli>(high_resolution_clock::now() - start).count();
+
+    {
+      std::lock_guard<std::mutex> lk(mutex);
+      simulation_ms = elapsed_ms;
+      simulated_frames++;
+    }
+    cv.notify_all();
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef MEINEKRAFT_SIMULATIONTHREAD_H
+#define MEINEKRAFT_SIMULATIONTHREAD_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "inlinefunction.h"
+
+/// Simulates the next frame on a dedicated thread while the main (GL) thread submits the current one
+/// The two threads meet once per frame in hand_off, the only point where they synchronise. Everything shared
+/// between the simulation and the renderer (e.g the render snapshots) is exchanged while both are stopped there.
+struct SimulationThread {
+  /// simulate(frame, delta) is run once per frame on the simulation thread
+  explicit SimulationThread(const std::function<void(uint64_t, int64_t)>& simulate);
+  ~SimulationThread();
+
+  /// Blocking - waits for the frame in flight, calls sync with both threads stopped and starts simulating the next frame
+  void hand_off(const int64_t delta, const InlineFunction<void()>& sync);
+
+  /// Blocking - finishes the frame in flight and joins the thread, called by the destructor
+  void stop();
+
+  /// Wall time of the last simulated frame, only read it within the sync function of hand_off
+  double get_simulation_ms() const { return simulation_ms; }
+
+  /// Time the main thread spent blocked in the last hand_off waiting for the simulation
+  double get_hand_off_wait_ms() const { return hand_off_wait_ms; }
+
+private:
+  std::function<void(uint64_t, int64_t)> simulate;
+  std::thread thread;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint64_t requested_frames = 0;  // Frames handed off to the simulation thread
+  uint64_t simulated_frames = 0;  // Frames the simulation thread has finished
+  int64_t frame_delta = 0;        // Delta of the frame in flight
+  bool exiting = false;
+
+  double simulation_ms = 0.0;
+  double hand_off_wait_ms = 0.0;
+
+  void loop();
+};
+
+#endif // MEINEKRAFT_SIMULATIONTHREAD_H
@@ -0,0 +1,155 @@
+#pragma once
+#ifndef MEINEKRAFT_SPARSESET_H
+#define MEINEKRAFT_SPARSESET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/// Entity IDs are generational handles, the low 32 bits index the entity and the high 32 bits count how many
+/// times that index has been reused. A stale ID of a destroyed entity thus never matches the entity reusing its index.
+inline uint32_t entity_index(const uint64_t id) { return uint32_t(id); }
+inline uint32_t entity_generation(const uint64_t id) { return uint32_t(id >> 32); }
+inline uint64_t make_entity_id(const uint32_t index, const uint32_t generation) {
+  return (uint64_t(generation) << 32) | uint64_t(index);
+}
+
+/// Moves the last element into slot and pops it, the same way SparseIndex::remove moves the ids
+template<typename T>
+inline void swap_remove(std::vector<T>& array, const size_t slot) {
+  if (slot + 1 != array.size()) { array[slot] = std::move(array.back()); }
+  array.pop_back();
+}
+
+/// Maps entity IDs to packed slots [0, size), O(1) insert, remove and lookup
+/// The sparse array is indexed by the entity index and holds the slot, the dense array holds the full ID of each
+/// slot so that lookups with stale IDs fail. Removal moves the last slot into the hole, owners of data indexed by
+/// slot do the same with swap_remove to stay packed.
+struct SparseIndex {
+  static const size_t npos = SIZE_MAX;
+
+  /// Slot of the ID, npos if it is not in the index
+  size_t find(const uint64_t id) const {
+    const uint32_t index = entity_index(id);
+    if (index >= sparse.size()) { return npos; }
+    const uint32_t slot = sparse[index];
+    if (slot == empty || dense[slot] != id) { return npos; }
+    return slot;
+  }
+
+  bool contains(const uint64_t id) const { return find(id) != npos; }
+
+  /// Slot of the ID with the entity index, of whichever generation, npos if there is none
+  size_t find_index(const uint32_t index) const {
+    if (index >= sparse.size() || sparse[index] == empty) { return npos; }
+    return sparse[index];
+  }
+
+  /// Appends the ID and returns its slot, an ID already in the index keeps its slot
+  /// An older generation of the ID (never removed) is replaced in its slot, owners of data indexed by slot overwrite
+  /// theirs when the returned slot is not the new last one
+  size_t insert(const uint64_t id) {
+    const uint32_t index = entity_index(id);
+    const size_t existing = find_index(index);
+    if (existing != npos) {
+      dense[existing] = id;
+      return existing;
+    }
+    if (index >= sparse.size()) { sparse.resize(index + 1, uint32_t(empty)); }
+    sparse[index] = uint32_t(dense.size());
+    dense.push_back(id);
+    return dense.size() - 1;
+  }
+
+  /// Removes the ID and returns the slot it had, the last slot (if any other) has been moved into it
+  /// Returns npos if the ID is not in the index
+  size_t remove(const uint64_t id) {
+    const size_t slot = find(id);
+    if (slot == npos) { return npos; }
+    sparse[entity_index(dense.back())] = uint32_t(slot);
+    sparse[entity_index(id)] = empty;
+    swap_remove(dense, slot);
+    return slot;
+  }
+
+  /// ID in the slot
+  uint64_t id_at(const size_t slot) const { return dense[slot]; }
+
+  /// IDs in slot order
+  const std::vector<uint64_t>& ids() const { return dense; }
+
+  size_t size() const { return dense.size(); }
+
+  /// Makes room for count IDs in total, so that inserting up to that many does not reallocate
+  void reserve(const size_t count) { dense.reserve(count); }
+
+  void clear() {
+    sparse.clear();
+    dense.clear();
+  }
+
+private:
+  static const uint32_t empty = UINT32_MAX;
+  std::vector<uint32_t> sparse; // Entity index to slot
+  std::vector<uint64_t> dense;  // Slot to entity ID
+};
+
+/// SparseIndex with a single packed array of values
+template<typename T>
+struct SparseSet {
+  /// Value of the ID, nullptr if it is not in the set
+  T* find(const uint64_t id) {
+    const size_t slot = index.find(id);
+    return slot == SparseIndex::npos ? nullptr : &values[slot];
+  }
+
+  const T* find(const uint64_t id) const {
+    const size_t slot = index.find(id);
+    return slot == SparseIndex::npos ? nullptr : &values[slot];
+  }
+
+  bool contains(const uint64_t id) const { return index.contains(id); }
+
+  /// Inserts or overwrites the value of the ID
+  T& insert(const uint64_t id, const T& value) {
+    const size_t slot = index.insert(id);
+    if (slot == values.size()) {
+      values.push_back(value);
+    } else {
+      values[slot] = value;
+    }
+    return values[slot];
+  }
+
+  /// Returns false if the ID is not in the set
+  bool remove(const uint64_t id) {
+    const size_t slot = index.remove(id);
+    if (slot == SparseIndex::npos) { return false; }
+    swap_remove(values, slot);
+    return true;
+  }
+
+  size_t size() const { return values.size(); }
+
+  void reserve(const size_t count) {
+    index.reserve(count);
+    values.reserve(count);
+  }
+
+  /// Values and their IDs in slot order, packed
+  std::vector<T>& dense() { return values; }
+  const std::vector<T>& dense() const { return values; }
+  const std::vector<uint64_t>& ids() const { return index.ids(); }
+
+  void clear() {
+    index.clear();
+    values.clear();
+  }
+
+private:
+  SparseIndex index;
+  std::vector<T> values;
+};
+
+#endif // MEINEKRAFT_SPARSESET_H
@@ -0,0 +1,104 @@
+#include "taskgraph.h"
+
+static uint32_t to_mask(std::initializer_list<ComponentType> types) {
+  uint32_t mask = 0;
+  for (const auto type : types) {
+    mask |= uint32_t(type);
+  }
+  return mask;
+}
+
+void TaskGraph::add_system(const std::string& name, std::initializer_list<ComponentType> reads,
+                           std::initializer_list<ComponentType> writes, const std::function<void()>& func) {
+  std::unique_ptr<System> system(new System());
+  system->name = name;
+  system->reads = to_mask(reads);
+  system->writes = to_mask(writes);
+  system->func = func;
+  system->unfinished_dependencies = 0;
+  system->start_ms = 0.0;
+  system->duration_ms = 0.0;
+
+  const size_t idx = systems.size();
+  for (size_t i = 0; i < systems.size(); i++) {
+    const auto& other = systems[i];
+    const bool write_conflict = other->writes & (system->reads | system->writes);
+    const bool read_conflict  = other->reads & system->writes;
+    if (write_conflict || read_conflict) {
+      system->dependencies.push_back(i);
+      other->dependents.push_back(idx);
+    }
+  }
+  systems.push_back(std::move(system));
+  finish_ms.resize(systems.size());
+  predecessors.resize(systems.size());
+  stats.critical_path.reserve(systems.size());
+  stats.start_ms.resize(systems.size());
+  stats.duration_ms.resize(systems.size());
+}
+
+void TaskGraph::run_system(const size_t idx, JobCounter& counter, const std::chrono::high_resolution_clock::time_point frame_start) {
+  using namespace std::chrono;
+  auto& system = *systems[idx];
+  const auto start = high_resolution_clock::now();
+  system.func();
+  const auto end = high_resolution_clock::now();
+  system.start_ms = duration<double, std::milli>(start - frame_start).count();
+  system.duration_ms = duration<double, std::milli>(end - start).count();
+
+  // Launch the dependents whose last dependency was this system, before this job is counted as done
+  for (const auto dependent : system.dependents) {
+    if (systems[dependent]->unfinished_dependencies.fetch_sub(1) == 1) {
+      JobSystem::instance().execute([=, &counter]() { run_system(dependent, counter, frame_start); }, &counter);
+    }
+  }
+}
+
+void TaskGraph::execute() {
+  using namespace std::chrono;
+  const auto frame_start = high_resolution_clock::now();
+
+  for (auto& system : systems) {
+    system->unfinished_dependencies = uint32_t(system->dependencies.size());
+  }
+
+  JobCounter counter;
+  for (size_t i = 0; i < systems.size(); i++) {
+    if (!systems[i]->dependencies.empty()) { continue; }
+    JobSystem::instance().execute([=, &counter]() { run_system(i, counter, frame_start); }, &counter);
+  }
+  JobSystem::instance().wait(counter);
+
+  stats.frame_ms = duration<double, std::milli>(high_resolution_clock::now() - frame_start).count();
+  for (size_t i = 0; i < systems.size(); i++) {
+    stats.start_ms[i] = systems[i]->start_ms;
+    stats.duration_ms[i] = systems[i]->duration_ms;
+  }
+  compute_critical_path();
+}
+
+void TaskGraph::compute_critical_path() {
+  // Systems are stored in a topological order since dependencies only point to earlier systems
+  size_t last = systems.size();
+  stats.critical_path_ms = 0.0;
+  for (size_t i = 0; i < systems.size(); i++) {
+    predecessors[i] = systems.size();
+    double longest_dependency_ms = 0.0;
+    for (const auto dependency : systems[i]->dependencies) {
+      if (finish_ms[dependency] >= longest_dependency_ms) {
+        longest_dependency_ms = finish_ms[dependency];
+        predecessors[i] = dependency;
+      }
+    }
+    finish_ms[i] = longest_dependency_ms + systems[i]->duration_ms;
+    if (finish_ms[i] >= stats.critical_path_ms) {
+      stats.critical_path_ms = finish_ms[i];
+      last = i;
+    }
+  }
+
+  stats.critical_path.clear();
+  for (size_t i = last; i < systems.size(); i = predecessors[i]) {
+    stats.critical_path.insert(stats.critical_path.begin(), i);
+  }
+}
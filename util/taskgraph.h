@@ -0,0 +1,83 @@
+#pragma once
+#ifndef MEINEKRAFT_TASKGRAPH_H
+#define MEINEKRAFT_TASKGRAPH_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "jobsystem.h"
+
+/// Component types that the engine systems read or write, used to derive the ordering of the systems
+enum class ComponentType: uint32_t {
+  Camera    = 1 << 0,
+  Action    = 1 << 1,
+  Transform = 1 << 2,
+  Render    = 1 << 3,
+  World     = 1 << 4,
+  Spatial   = 1 << 5,
+  Animation = 1 << 6
+};
+
+/// Per-frame graph of engine systems executed on the JobSystem
+/// A system runs after every previously added system that writes what it reads or writes, or reads what it writes.
+/// Systems without such conflicts run concurrently.
+struct TaskGraph {
+  struct System {
+    std::string name;
+    uint32_t reads;
+    uint32_t writes;
+    std::function<void()> func;
+    std::vector<size_t> dependencies;   // Systems that must finish before this one starts
+    std::vector<size_t> dependents;     // Systems waiting on this one
+    std::atomic<uint32_t> unfinished_dependencies;
+
+    /// Timings of the last executed frame in ms, relative to the start of the frame
+    double start_ms;
+    double duration_ms;
+  };
+
+  /// Timings of the last executed frame, a plain copy of it can be read while the graph runs the next one
+  struct FrameStats {
+    double frame_ms = 0.0;                // Wall time of the frame
+    double critical_path_ms = 0.0;
+    std::vector<size_t> critical_path;    // Longest chain of dependent systems, first system first
+    std::vector<double> start_ms;         // Per system, relative to the start of the frame
+    std::vector<double> duration_ms;      // Per system
+  };
+
+  /// Adds a system and derives its dependencies from the systems added before it
+  void add_system(const std::string& name, std::initializer_list<ComponentType> reads,
+                  std::initializer_list<ComponentType> writes, const std::function<void()>& func);
+
+  /// Runs all the systems once, blocks until all of them are done
+  void execute();
+
+  /// Systems in the order they were added
+  const std::vector<std::unique_ptr<System>>& get_systems() const { return systems; }
+
+  /// Longest chain of dependent systems of the last executed frame, first system first
+  const std::vector<size_t>& get_critical_path() const { return stats.critical_path; }
+  double get_critical_path_ms() const { return stats.critical_path_ms; }
+
+  /// Wall time of the last executed frame
+  double get_frame_ms() const { return stats.frame_ms; }
+
+  const FrameStats& get_stats() const { return stats; }
+
+private:
+  std::vector<std::unique_ptr<System>> systems;
+  FrameStats stats;
+  std::vector<double> finish_ms;        // Scratch space of compute_critical_path, sized by add_system
+  std::vector<size_t> predecessors;     // Scratch space of compute_critical_path, sized by add_system
+
+  void run_system(const size_t idx, JobCounter& counter, const std::chrono::high_resolution_clock::time_point frame_start);
+  void compute_critical_path();
+};
+
+#endif // MEINEKRAFT_TASKGRAPH_H